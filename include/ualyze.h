@@ -56,6 +56,132 @@ UAL_API ual_buffer* ual_buffer_create();
 UAL_API ual_buffer* ual_buffer_retain( ual_buffer* ub );
 UAL_API void ual_buffer_release( ual_buffer* ub );
 
+/*
+    Options enable additional outputs from analysis.  Options are the bitwise
+    or of UAL_OPTION_* flags, which are described below.
+*/
+
+UAL_API void ual_buffer_options( ual_buffer* ub, unsigned options );
+
+/*
+    If the library is built with UAL_STATS, each buffer counts the work done
+    by analysis, and the time spent in each stage, in processor ticks.
+    Counters accumulate until reset.  ual_buffer_stats returns false if the
+    library was built without UAL_STATS.
+
+    Each thread should use its own buffer.  ual_stats_add sums the counters
+    of several buffers.
+*/
+
+typedef struct ual_stats
+{
+    uint64_t break_paragraphs;      // calls to ual_analyze_breaks.
+    uint64_t break_units;           // encoding units analyzed for breaks.
+    uint64_t break_ticks;           // time in ual_analyze_breaks.
+
+    uint64_t bidi_paragraphs;       // calls to ual_analyze_bidi.
+    uint64_t bidi_units;            // encoding units analyzed for bidi.
+    uint64_t explicit_ticks;        // time in class lookup and rules X1-X10.
+    uint64_t weak_ticks;            // time in rules W1-W7.
+    uint64_t brackets_ticks;        // time in rule N0.
+    uint64_t neutral_ticks;         // time in rules N1-N2 and I1-I2.
+    uint64_t whitespace_ticks;      // time in rule L1.
+    uint64_t runs_ticks;            // time building bidi runs.
+
+    uint64_t level_runs;            // level runs found.
+    uint64_t brackets_pushed;       // opening brackets pushed on the bracket stack.
+    uint64_t rewinds;               // rewinds after a bracket pair changes direction.
+    uint64_t lookahead;             // units scanned ahead for the first strong class.
+} ual_stats;
+
+UAL_API bool ual_buffer_stats( ual_buffer* ub, ual_stats* out_stats );
+UAL_API void ual_buffer_stats_reset( ual_buffer* ub );
+UAL_API void ual_stats_add( ual_stats* total, const ual_stats* stats );
+
+/*
+    The library can also collect statistics describing the text it analyzes,
+    across all buffers and threads.  Collection is off until enabled.  Each
+    histogram counts paragraphs.
+
+      - complexity is indexed by UAL_COMPLEXITY_*, the amount of the bidi
+        algorithm which a paragraph required.
+      - length is indexed by the bit length of the paragraph length in
+        encoding units, so bucket i counts lengths in [2^(i-1), 2^i).
+      - surrogates is indexed by the fraction of units in surrogate pairs,
+        in eighths rounded up.
+      - script_spans is indexed by the bit length of the number of script
+        spans, counted when iteration reaches the end of the paragraph.
+
+    Counters are updated without locks, so a snapshot taken while other
+    threads are analyzing text may not be consistent between counters.
+    ual_workload_dump formats a snapshot as text, returning the length of
+    the text in the same way as snprintf.
+*/
+
+const unsigned UAL_COMPLEXITY_ALL_LEFT = 0;
+const unsigned UAL_COMPLEXITY_ALL_RIGHT = 1;
+const unsigned UAL_COMPLEXITY_STRONG = 2;
+const unsigned UAL_COMPLEXITY_SOLITARY = 3;
+const unsigned UAL_COMPLEXITY_ISOLATES = 4;
+const unsigned UAL_COMPLEXITY_EXPLICIT = 5;
+const unsigned UAL_COMPLEXITY_COUNT = 6;
+
+const unsigned UAL_WORKLOAD_LENGTH_BUCKETS = 24;
+const unsigned UAL_WORKLOAD_SURROGATE_BUCKETS = 9;
+const unsigned UAL_WORKLOAD_SPAN_BUCKETS = 12;
+
+typedef struct ual_workload
+{
+    uint64_t paragraphs;            // paragraphs identified.
+    uint64_t units;                 // encoding units in those paragraphs.
+    uint64_t surrogate_units;       // encoding units in surrogate pairs.
+    uint64_t complexity[ UAL_COMPLEXITY_COUNT ];
+    uint64_t length[ UAL_WORKLOAD_LENGTH_BUCKETS ];
+    uint64_t surrogates[ UAL_WORKLOAD_SURROGATE_BUCKETS ];
+    uint64_t script_spans[ UAL_WORKLOAD_SPAN_BUCKETS ];
+} ual_workload;
+
+UAL_API void ual_workload_enable( bool enable );
+UAL_API void ual_workload_reset();
+UAL_API void ual_workload_snapshot( ual_workload* out_workload );
+UAL_API size_t ual_workload_dump( char* buffer, size_t size );
+
+/*
+    A ual_cache holds the results of analysis of recently seen paragraphs,
+    for clients which analyze the same text many times.  Once a cache is
+    attached to a buffer, break analysis, script spans, and bidi analysis of
+    a paragraph whose text matches a cached paragraph restore the cached
+    results instead of repeating the analysis.  Bidi results are cached
+    separately for each override paragraph level.  After restoring cached
+    bidi results, the bc member of each ual_char is not updated.
+
+    The cache is refcounted, and can be shared by buffers on any number of
+    threads.  It is split into shards with separate locks.  When a shard
+    exceeds its share of the memory budget, the least recently used results
+    are evicted.  Memory is reported in bytes.
+*/
+
+typedef struct ual_cache ual_cache;
+
+UAL_API ual_cache* ual_cache_create( size_t memory_budget );
+UAL_API ual_cache* ual_cache_retain( ual_cache* cache );
+UAL_API void ual_cache_release( ual_cache* cache );
+
+UAL_API void ual_buffer_cache( ual_buffer* ub, ual_cache* cache );
+
+typedef struct ual_cache_stats
+{
+    uint64_t lookups;               // lookups of cached results.
+    uint64_t hits;                  // lookups which found a result.
+    uint64_t insertions;            // results added.
+    uint64_t evictions;             // results evicted to stay within budget.
+    size_t entries;                 // results currently cached.
+    size_t memory;                  // memory used by cached results.
+    size_t memory_budget;
+} ual_cache_stats;
+
+UAL_API void ual_cache_stats_get( ual_cache* cache, ual_cache_stats* out_stats );
+
 /*
     Analysis is performed on UTF-16 text.  The buffer retains an internal
     pointer to the string.  The caller is responsible for keeping the string
@@ -78,14 +204,34 @@ UAL_API size_t ual_analyze_paragraph( ual_buffer* ub, const char16_t* text, size
     class after bidi analysis, or contains breaking flags after break analysis.
 
     Text is a pointer to the same UTF-16 string provided by the client.
+
+    If the library is built with UAL_WIDE, which lifts internal limits on the
+    size of a paragraph, clients must also define UAL_WIDE.  Positions in
+    break lists are then 64-bit.
 */
 
+#if defined( UAL_WIDE )
+
+typedef uint64_t ual_position;
+
+typedef struct ual_char
+{
+    uint32_t ix : 24;   // private
+    uint32_t bc : 8;    // bidi class or break flags
+} ual_char;
+
+#else
+
+typedef uint32_t ual_position;
+
 typedef struct ual_char
 {
     uint16_t ix : 11;   // private
     uint16_t bc : 5;    // bidi class or break flags
 } ual_char;
 
+#endif
+
 
 UAL_API const char16_t* ual_buffer_text( ual_buffer* ub );
 UAL_API const ual_char* ual_buffer_chars( ual_buffer* ub );
@@ -108,6 +254,151 @@ const uint16_t UAL_BREAK_SPACES     = 1 << 2;
 
 UAL_API void ual_analyze_breaks( ual_buffer* ub );
 
+/*
+    ual_analyze_all identifies the first paragraph in the text and performs
+    break analysis, as ual_analyze_paragraph followed by ual_analyze_breaks,
+    but in a single pass over the text.  The same pass looks up the initial
+    bidi class of each character into separate storage, so that the break
+    flags are not overwritten and a later call to ual_analyze_bidi does not
+    look up each character again.  Returns the length of the paragraph.
+*/
+
+UAL_API size_t ual_analyze_all( ual_buffer* ub, const char16_t* text, size_t size );
+
+/*
+    Break analysis can also produce sorted lists of the positions at which
+    each break flag is set, so that clients interested in one kind of break
+    do not have to scan every character.  Lists are only built if enabled in
+    the buffer's options.  Positions are either ual_position offsets, or the
+    differences between successive positions encoded as LEB128 varints
+    (the first difference is from zero).
+*/
+
+const unsigned UAL_OPTION_BREAK_LISTS   = 1 << 0;
+const unsigned UAL_OPTION_BREAK_VARINT  = 1 << 1;
+
+typedef struct ual_break_list
+{
+    size_t count;               // number of positions.
+    const ual_position* positions;  // UAL_OPTION_BREAK_LISTS, otherwise NULL.
+    const uint8_t* varint;      // UAL_OPTION_BREAK_VARINT, otherwise NULL.
+    size_t varint_size;         // size of varint data in bytes.
+} ual_break_list;
+
+UAL_API bool ual_break_list_get( ual_buffer* ub, uint16_t break_flag, ual_break_list* out_list );
+
+static inline const uint8_t* ual_varint_next( const uint8_t* p, ual_position* io_position )
+{
+    ual_position delta = 0;
+    unsigned shift = 0;
+    while ( *p & 0x80 )
+    {
+        delta |= (ual_position)( *p++ & 0x7F ) << shift;
+        shift += 7;
+    }
+    delta |= (ual_position)*p++ << shift;
+    *io_position += delta;
+    return p;
+}
+
+/*
+    Break analysis can build an index of grapheme clusters, which answers
+    queries about cluster boundaries in constant time.  Clusters are numbered
+    from zero.  The start of cluster ual_cluster_count is the end of the
+    paragraph.
+
+    ual_cluster_of returns the number of the cluster containing an index.
+    ual_cluster_start returns the index of the start of a cluster.
+    ual_cluster_next returns the first cluster boundary after an index.
+    ual_cluster_prev returns the last cluster boundary before an index.
+*/
+
+const unsigned UAL_OPTION_CLUSTER_INDEX = 1 << 2;
+
+UAL_API size_t ual_cluster_count( ual_buffer* ub );
+UAL_API size_t ual_cluster_of( ual_buffer* ub, size_t index );
+UAL_API size_t ual_cluster_start( ual_buffer* ub, size_t cluster );
+UAL_API size_t ual_cluster_next( ual_buffer* ub, size_t index );
+UAL_API size_t ual_cluster_prev( ual_buffer* ub, size_t index );
+
+/*
+    After break analysis, fit the paragraph into lines of a given width.  The
+    client provides the advance width of each encoding unit (low surrogates
+    should have zero width).  Break opportunities are the only places a line
+    can end.  The run of spaces before each break opportunity is glue - it
+    can stretch or shrink inside a line, and does not count towards the width
+    of a line which ends at that break.
+
+    ual_fit_greedy places as much text as possible on each line.
+
+    ual_fit_optimal chooses the set of breaks which minimizes the total
+    demerits of all lines in the paragraph (the Knuth-Plass total-fit
+    algorithm).  Only the most recent window break opportunities are
+    considered as the start of each line, so a line never spans more than
+    window break opportunities (zero selects a default).  If a demerits
+    function is provided, it is called to score each candidate line,
+    otherwise TeX's formula is used.  A line which overflows is only
+    considered if there is no other choice.
+
+    Both functions return the number of lines.  Lines are reported using an
+    iterator-style interface.  The ratio of each line is the amount its glue
+    was stretched (positive) or shrunk (negative), as a proportion of the
+    total available stretch or shrink.
+*/
+
+typedef struct ual_line
+{
+    size_t lower;
+    size_t upper;
+    size_t spaces;      // start of trailing spaces, <= upper.
+    float width;        // natural width of line, excluding trailing spaces.
+    float ratio;        // adjustment ratio.
+} ual_line;
+
+typedef float ual_demerits_func( void* context, const ual_line* line, bool last );
+
+typedef struct ual_fit_params
+{
+    float width;                    // width of each line.
+    float stretch;                  // stretchability of glue, relative to its width.
+    float shrink;                   // shrinkability of glue, relative to its width.
+    unsigned window;                // maximum active break opportunities.
+    ual_demerits_func* demerits;    // or NULL for the default.
+    void* context;                  // passed to the demerits function.
+} ual_fit_params;
+
+UAL_API size_t ual_fit_greedy( ual_buffer* ub, const float* advances, const ual_fit_params* params );
+UAL_API size_t ual_fit_optimal( ual_buffer* ub, const float* advances, const ual_fit_params* params );
+
+UAL_API void ual_lines_begin( ual_buffer* ub );
+UAL_API bool ual_lines_next( ual_buffer* ub, ual_line* out_line );
+UAL_API void ual_lines_end( ual_buffer* ub );
+
+/*
+    A ual_skeleton captures the parts of line fitting which do not depend on
+    the line width - the positions of break opportunities, the extents of the
+    space runs before them, and the width of the text between them.  It is
+    created from a buffer after break analysis, and does not refer to the
+    buffer or the text afterwards.
+
+    A skeleton is immutable and refcounted, and can be queried from any
+    number of threads at once.  Each query fits lines for a given width and
+    returns the number of lines.  The buffer passed to a query holds its
+    working storage and the lines, which are reported using ual_lines_begin,
+    as for ual_fit_greedy and ual_fit_optimal.  Queries on different threads
+    must use different buffers.  The buffer's paragraph is not changed.
+*/
+
+typedef struct ual_skeleton ual_skeleton;
+
+UAL_API ual_skeleton* ual_skeleton_create( ual_buffer* ub, const float* advances );
+UAL_API ual_skeleton* ual_skeleton_retain( ual_skeleton* sk );
+UAL_API void ual_skeleton_release( ual_skeleton* sk );
+
+UAL_API size_t ual_skeleton_size( const ual_skeleton* sk );
+UAL_API size_t ual_skeleton_greedy( const ual_skeleton* sk, ual_buffer* ub, const ual_fit_params* params );
+UAL_API size_t ual_skeleton_optimal( const ual_skeleton* sk, ual_buffer* ub, const ual_fit_params* params );
+
 /*
     Split the paragraph into spans containing runs of the same script.  The
     script code is a 4-character identifier from ISO 15924, with the first
@@ -141,8 +432,9 @@ const unsigned UAL_FROM_TEXT = ~(unsigned)0;
 UAL_API unsigned ual_analyze_bidi( ual_buffer* ub, unsigned override_paragraph_level );
 
 /*
-    With resolved bidi classes,  split the paragraph into bidi runs.  This
-    process does *not* require the internal stack.
+    Bidi analysis splits the paragraph into bidi runs.  Runs remain valid
+    until the next paragraph.  Iterating over runs does *not* require the
+    internal stack or resolved bidi classes.
 */
 
 typedef struct ual_bidi_run
@@ -156,6 +448,176 @@ UAL_API void ual_bidi_runs_begin( ual_buffer* ub );
 UAL_API bool ual_bidi_runs_next( ual_buffer* ub, ual_bidi_run* out_run );
 UAL_API void ual_bidi_runs_end( ual_buffer* ub );
 
+/*
+    With UAL_OPTION_BIDI_MIRRORS, bidi analysis also finds the characters in
+    each run which must be replaced by their mirrored glyph (rule L4).
+    ual_bidi_run_mirrors returns these for the most recent run, in order of
+    index.
+*/
+
+const unsigned UAL_OPTION_BIDI_MIRRORS = 1 << 3;
+
+typedef struct ual_bidi_mirror
+{
+    size_t index;
+    uint32_t mirror;    // mirrored codepoint.
+} ual_bidi_mirror;
+
+UAL_API const ual_bidi_mirror* ual_bidi_run_mirrors( ual_buffer* ub, size_t* out_count );
+
+/*
+    Bidi analysis also identifies isolating run sequences, which are resolved
+    as if the text in each sequence was contiguous.  Each sequence is a list of
+    ranges in text order, all at the same embedding level.  sos and eos are the
+    directions at the start and end of the sequence, 0 for L or 1 for R.
+
+    Ranges include characters removed by rule X9.  The ranges of a sequence
+    remain valid until the next call to ual_bidi_sequences_next.
+*/
+
+typedef struct ual_bidi_range
+{
+    size_t lower;
+    size_t upper;
+} ual_bidi_range;
+
+typedef struct ual_bidi_sequence
+{
+    unsigned level;
+    unsigned sos;
+    unsigned eos;
+    size_t range_count;
+    const ual_bidi_range* ranges;
+} ual_bidi_sequence;
+
+UAL_API void ual_bidi_sequences_begin( ual_buffer* ub );
+UAL_API bool ual_bidi_sequences_next( ual_buffer* ub, ual_bidi_sequence* out_sequence );
+UAL_API void ual_bidi_sequences_end( ual_buffer* ub );
+
+/*
+    After bidi analysis, write the embedding level of each encoding unit in
+    the paragraph to an array with ual_buffer_size() entries.  Units
+    ignored by the bidi algorithm take the level of the preceding unit, as
+    they do in bidi runs.
+
+    ual_bidi_line_levels writes the levels of units in [lower, upper) only,
+    and also applies rule L1 to whitespace at the end of the line.
+*/
+
+UAL_API void ual_bidi_levels( ual_buffer* ub, uint8_t* out_levels );
+UAL_API void ual_bidi_line_levels( ual_buffer* ub, size_t lower, size_t upper, uint8_t* out_levels );
+
+/*
+    Batch bidi analysis of many short strings, such as notification text.
+    Each string is analyzed as if by calls to ual_analyze_paragraph and
+    ual_analyze_bidi, and its bidi runs are written to out_runs, following
+    the runs of the previous string.  Run positions are relative to the start
+    of the string.  A string containing paragraph breaks is analyzed one
+    paragraph at a time, and reports the level of its first paragraph.
+
+    Returns the number of strings analyzed, which is less than count if
+    out_runs does not have room for the runs of the next string.  Afterwards,
+    the buffer holds no paragraph.
+*/
+
+typedef struct ual_bidi_batch_string
+{
+    const char16_t* text;
+    size_t size;
+} ual_bidi_batch_string;
+
+typedef struct ual_bidi_batch_result
+{
+    unsigned paragraph_level;
+    size_t run_index;       // index of first run in out_runs.
+    size_t run_count;
+} ual_bidi_batch_result;
+
+UAL_API size_t ual_analyze_bidi_batch( ual_buffer* ub, const ual_bidi_batch_string* strings, size_t count, unsigned override_paragraph_level, ual_bidi_batch_result* out_results, ual_bidi_run* out_runs, size_t runs_size );
+
+/*
+    Results of analysis can be computed offline and stored in an archive, a
+    compact binary format which can be loaded or mapped into memory and read
+    in place.
+
+    ual_archive_writer_add analyzes the current paragraph of a buffer (breaks,
+    script spans, and bidi with the given override level) and appends the
+    results.  ual_archive_writer_data returns the archive, which remains valid
+    until the writer is modified or released.
+
+    ual_archive_open checks the header of an archive and its table of
+    paragraphs.  Each paragraph records its offset in the concatenated text
+    of all paragraphs added to the writer.  Break positions are stored as
+    varints, and are returned as break lists with no positions array.  Script
+    spans and bidi runs are returned using iterators which read the archive
+    directly.
+
+    Reading never goes outside the sections of a paragraph, or past its
+    length.  A paragraph whose sections lie outside the archive is rejected,
+    as is a break list whose varints overrun its section.  Iteration stops at
+    a span or run which overruns its section or the paragraph.
+
+    The format is little-endian.  The archive starts with a 16 byte header
+    (magic "UALZ", 16-bit version, 16-bit reserved, 64-bit paragraph count),
+    followed by a table with a 40 byte entry for each paragraph (64-bit data
+    offset, 64-bit text offset, then 32-bit length and sizes of the break,
+    script, and bidi sections, and the 8-bit paragraph level), followed by
+    the data of each paragraph.  Even with UAL_WIDE, paragraphs in an archive
+    must have fewer than 2^32 units.
+*/
+
+const unsigned UAL_ARCHIVE_VERSION = 1;
+
+typedef struct ual_archive_writer ual_archive_writer;
+
+UAL_API ual_archive_writer* ual_archive_writer_create();
+UAL_API ual_archive_writer* ual_archive_writer_retain( ual_archive_writer* aw );
+UAL_API void ual_archive_writer_release( ual_archive_writer* aw );
+
+UAL_API void ual_archive_writer_add( ual_archive_writer* aw, ual_buffer* ub, unsigned override_paragraph_level );
+UAL_API const void* ual_archive_writer_data( ual_archive_writer* aw, size_t* out_size );
+
+typedef struct ual_archive
+{
+    const uint8_t* data;
+    size_t size;
+    size_t paragraph_count;
+} ual_archive;
+
+typedef struct ual_archive_paragraph
+{
+    size_t text_offset;             // offset of paragraph in text.
+    size_t length;                  // length of paragraph in encoding units.
+    unsigned paragraph_level;
+    const uint8_t* breaks;
+    const uint8_t* scripts;
+    const uint8_t* bidi;
+    size_t break_size;              // size of each section in bytes.
+    size_t script_size;
+    size_t bidi_size;
+} ual_archive_paragraph;
+
+typedef struct ual_archive_iterator
+{
+    const uint8_t* p;
+    const uint8_t* end;             // end of section.
+    size_t count;                   // items remaining.
+    size_t index;                   // end of previous item.
+    size_t length;
+    unsigned paragraph_level;
+} ual_archive_iterator;
+
+UAL_API bool ual_archive_open( ual_archive* archive, const void* data, size_t size );
+UAL_API bool ual_archive_paragraph_get( const ual_archive* archive, size_t index, ual_archive_paragraph* out_paragraph );
+
+UAL_API bool ual_archive_break_list_get( const ual_archive_paragraph* ap, uint16_t break_flag, ual_break_list* out_list );
+
+UAL_API void ual_archive_script_spans_begin( const ual_archive_paragraph* ap, ual_archive_iterator* it );
+UAL_API bool ual_archive_script_spans_next( ual_archive_iterator* it, ual_script_span* out_span );
+
+UAL_API void ual_archive_bidi_runs_begin( const ual_archive_paragraph* ap, ual_archive_iterator* it );
+UAL_API bool ual_archive_bidi_runs_next( ual_archive_iterator* it, ual_bidi_run* out_run );
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,110 @@
+//
+//  ualyze_literal.h
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#ifndef UALYZE_LITERAL_H
+#define UALYZE_LITERAL_H
+
+/*
+    Break analysis of string literals at compile time.
+
+        static constexpr auto breaks = ual::analyze_literal_breaks( u"Cancel" );
+        ual_break_list list = breaks.list( UAL_BREAK_LINE );
+
+    The literal is split into paragraphs and each paragraph is analyzed as by
+    ual_analyze_paragraph and ual_analyze_breaks.  Break flags and positions
+    are offsets from the start of the literal, so for a literal containing a
+    single paragraph they match the results of runtime analysis.  Only
+    breaks are computed at compile time, not script spans or bidi runs.
+
+    Analysis uses the loops of the template front end in ualyze_template.h,
+    with constant copies of the Unicode tables.  The copies are only used
+    during constant evaluation, so nothing is added to the program unless
+    analysis of a literal happens at run time.
+*/
+
+#include "ualyze_template.h"
+
+namespace ual
+{
+
+namespace detail
+{
+
+namespace literal
+{
+
+#define UCDB_TABLE_STORAGE constexpr
+#include "generated/table_data.h"
+#undef UCDB_TABLE_STORAGE
+
+}
+
+struct literal_tables
+{
+    static constexpr unsigned lookup( char32_t uc ) { return (unsigned)literal::ucdb_index( uc ); }
+    static constexpr const ucdb_entry& entry( unsigned ix ) { return literal::UCDB_TABLE[ ix ]; }
+};
+
+}
+
+/*
+    Results of break analysis of a literal with N code units, including the
+    terminator.  list returns a list compatible with ual_break_list_get, with
+    positions but no varints.
+*/
+
+template < size_t N >
+struct literal_breaks
+{
+    size_t size;
+    uint8_t flags[ N ];
+    size_t counts[ 3 ];
+    ual_position positions[ 3 ][ N ];
+
+    constexpr ual_break_list list( uint16_t break_flag ) const
+    {
+        for ( size_t ilist = 0; ilist < 3; ++ilist )
+        {
+            if ( break_flag == 1 << ilist )
+            {
+                return { counts[ ilist ], positions[ ilist ], nullptr, 0 };
+            }
+        }
+        return { 0, nullptr, nullptr, 0 };
+    }
+
+    constexpr void push( size_t ilist, size_t index )
+    {
+        flags[ index ] |= 1 << ilist;
+        positions[ ilist ][ counts[ ilist ]++ ] = (ual_position)index;
+    }
+
+    constexpr void cluster( size_t index ) { push( 0, index ); }
+    constexpr void line( size_t index ) { push( 1, index ); }
+    constexpr void spaces( size_t index ) { push( 2, index ); }
+};
+
+template < size_t N >
+constexpr literal_breaks< N > analyze_literal_breaks( const char16_t ( &text )[ N ] )
+{
+    literal_breaks< N > result = {};
+    result.size = N - 1;
+    size_t lower = 0;
+    while ( lower < result.size )
+    {
+        lower = detail::paragraph_breaks< breaks, detail::literal_tables >( text, result.size, lower, result );
+    }
+    return result;
+}
+
+}
+
+#endif
+
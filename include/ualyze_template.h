@@ -0,0 +1,355 @@
+//
+//  ualyze_template.h
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#ifndef UALYZE_TEMPLATE_H
+#define UALYZE_TEMPLATE_H
+
+/*
+    C++17 front end which selects analyses at compile time.
+
+        ual::analyze< ual::clusters | ual::script >( text, size, sink );
+
+    The text is split into paragraphs.  Paragraph identification and break
+    analysis are fused into a single pass over each paragraph, which only
+    runs the state machines for the selected breaks.  Results are passed
+    directly to the sink, which must provide the members for the selected
+    analyses:
+
+        ual::clusters   void cluster( size_t index );
+        ual::lines      void line( size_t index );
+                        void spaces( size_t index );
+        ual::script     void script_span( const ual_script_span& span );
+        ual::bidi       void bidi_run( const ual_bidi_run& run );
+        always          void paragraph( size_t lower, size_t upper );
+
+    Indices are offsets from the start of the text.  Breaks are reported in
+    order, as they are found, and paragraph is called at the end of each
+    paragraph.  Script spans and bidi runs are found by the library, using
+    the buffer if one is passed, so they follow the call to paragraph.
+
+    The library's own paragraph and break analysis use the same loops, with
+    a sink which writes to the buffer.  The loops look up properties in the
+    library's Unicode tables, or in constant copies of them when evaluated at
+    compile time (see ualyze_literal.h).
+
+    This header includes the Unicode database and break state machine
+    headers, which are not installed, and links against the library's Unicode
+    tables, which are not exported.  It can only be used in-tree, by the
+    library and by programs built from the library sources.  The meson
+    dependency does not provide these headers.
+*/
+
+#include "ualyze.h"
+#include "ucdb_table.h"
+#include "ucdb_script.h"
+
+namespace ual
+{
+
+const unsigned clusters = 1 << 0;
+const unsigned lines    = 1 << 1;
+const unsigned breaks   = clusters | lines;
+const unsigned script   = 1 << 2;
+const unsigned bidi     = 1 << 3;
+
+namespace detail
+{
+
+#define ACTION signed char
+#define BREAK( x ) -x-1
+#define NO_BREAK( x ) +x
+#define LOOKAHEAD_NU( x ) -x-63
+
+#include "uax14.h"
+#include "uax29p3.h"
+
+#undef ACTION
+#undef BREAK
+#undef NO_BREAK
+#undef LOOKAHEAD_NU
+
+/*
+    The sink is also passed each character, to the member
+
+        void character( size_t index, size_t next, unsigned ix, const ucdb_entry& uentry );
+
+    before its breaks are reported, where next is the index of the next
+    character and ix is the index of the character's entry in the table.
+*/
+
+const unsigned chars = 1 << 4;
+
+/*
+    Unicode tables.  Lookups at run time use the tables in the library.
+*/
+
+struct library_tables
+{
+    static unsigned lookup( char32_t uc ) { return (unsigned)ucdb_lookup( uc ); }
+    static const ucdb_entry& entry( unsigned ix ) { return ::UCDB_TABLE[ ix ]; }
+};
+
+const size_t NO_SPACE = ~(size_t)0;
+
+constexpr char32_t decode( const char16_t* text, size_t size, size_t* inout_index )
+{
+    // As ual_decode.
+    size_t index = *inout_index;
+    char32_t uc = text[ index++ ];
+    if ( ( uc & 0xF800 ) == 0xD800 )
+    {
+        char32_t ul = index < size ? text[ index ] : 0;
+        bool have_hi_surrogate = ( uc & 0xFC00 ) == 0xD800;
+        bool have_lo_surrogate = ( ul & 0xFC00 ) == 0xDC00;
+        if ( have_hi_surrogate && have_lo_surrogate )
+        {
+            uc = 0x010000 + ( ( uc & 0x3FF ) << 10 ) + ( ul & 0x3FF );
+            index += 1;
+        }
+        else
+        {
+            uc = 0xFFFD;
+        }
+    }
+
+    *inout_index = index;
+    return uc;
+}
+
+template < typename Tables >
+constexpr bool lookahead_nu( const char16_t* text, size_t size, size_t index )
+{
+    // The lookahead only follows OP, so the next character is always in the
+    // same paragraph.
+    if ( index >= size )
+    {
+        return false;
+    }
+    char32_t uc = decode( text, size, &index );
+    return Tables::entry( Tables::lookup( uc ) ).lbreak == UCDB_LBREAK_NU;
+}
+
+constexpr unsigned paragraph_lbreak( const ucdb_entry& uentry )
+{
+    // Paragraph separators with line break class CM are hard breaks.
+    unsigned lbreak = uentry.lbreak;
+    if ( lbreak == UCDB_LBREAK_CM && uentry.bclass == UCDB_BIDI_B )
+    {
+        lbreak = UCDB_LBREAK_BK;
+    }
+    return lbreak;
+}
+
+constexpr bool paragraph_break( unsigned prev, unsigned curr )
+{
+    // A paragraph ends after a hard break.
+    return prev == UCDB_LBREAK_BK
+        || prev == UCDB_LBREAK_NL
+        || prev == UCDB_LBREAK_LF
+        || ( prev == UCDB_LBREAK_CR && curr != UCDB_LBREAK_LF );
+}
+
+/*
+    Break state machines, run one character at a time.  The lookahead is only
+    called when the line break machine needs to know if the next character is
+    NU.  A run of spaces is reported when the break opportunity after it is
+    found, or at the end of the paragraph.
+*/
+
+struct break_state
+{
+    int lb_state;
+    int cb_state;
+    size_t space_index;
+    bool was_space;
+};
+
+constexpr break_state BREAK_START = { STATE_SOT_ZWJ, STATE_CONTROL_LF, NO_SPACE, false };
+
+template < unsigned A, typename Lookahead, typename Sink >
+constexpr void break_step( break_state* state, const ucdb_entry& uentry, size_t index, Lookahead lookahead, Sink& sink )
+{
+    // Cluster breaks.
+    if constexpr ( ( A & clusters ) != 0 )
+    {
+        int cb_state = UAX29P3[ state->cb_state ][ uentry.cbreak ];
+        if ( cb_state < 0 )
+        {
+            cb_state = -cb_state-1;
+            sink.cluster( index );
+        }
+        state->cb_state = cb_state;
+    }
+
+    // Line breaks, and runs of spaces before them.
+    if constexpr ( ( A & lines ) != 0 )
+    {
+        unsigned lb_class = uentry.lbreak;
+        int lb_state = UAX14[ state->lb_state ][ lb_class ];
+        if ( lb_state < 0 )
+        {
+            bool line = true;
+            if ( lb_state > -62 )
+            {
+                lb_state = -lb_state-1;
+            }
+            else
+            {
+                lb_state = -lb_state-63;
+                line = ! lookahead();
+            }
+
+            if ( state->was_space )
+            {
+                sink.spaces( state->space_index );
+            }
+            if ( line )
+            {
+                sink.line( index );
+            }
+
+            state->space_index = NO_SPACE;
+            state->was_space = false;
+        }
+        state->lb_state = lb_state;
+
+        bool is_space =
+               uentry.zspace                    // space characters
+            || lb_class == UCDB_LBREAK_ZW       // ZERO WIDTH SPACE
+            || lb_state == STATE_NL_LF_CR_BK;   // newlines
+        if ( is_space && ! state->was_space )
+        {
+            state->space_index = index;
+        }
+        state->was_space = is_space;
+    }
+}
+
+template < unsigned A, typename Sink >
+constexpr void break_end( break_state* state, Sink& sink )
+{
+    if constexpr ( ( A & lines ) != 0 )
+    {
+        if ( state->was_space )
+        {
+            sink.spaces( state->space_index );
+        }
+    }
+}
+
+template < unsigned A, typename Tables, typename Sink >
+constexpr size_t paragraph_breaks( const char16_t* text, size_t size, size_t lower, Sink& sink )
+{
+    // Identify the paragraph starting at lower, running the selected break
+    // machines at the same time, and return the end of the paragraph.
+    break_state state = BREAK_START;
+    unsigned prev = UCDB_LBREAK_XX;
+    size_t i = lower;
+    while ( i < size )
+    {
+        // Decode character and look up properties.
+        size_t inext = i;
+        char32_t uc = decode( text, size, &inext );
+        unsigned ix = Tables::lookup( uc );
+        const ucdb_entry& uentry = Tables::entry( ix );
+
+        // Check for end of paragraph.
+        unsigned curr = paragraph_lbreak( uentry );
+        if ( paragraph_break( prev, curr ) )
+        {
+            break;
+        }
+        prev = curr;
+
+        if constexpr ( ( A & chars ) != 0 )
+        {
+            sink.character( i, inext, ix, uentry );
+        }
+
+        if constexpr ( ( A & breaks ) != 0 )
+        {
+            auto lookahead = [ & ]() { return lookahead_nu< Tables >( text, size, inext ); };
+            break_step< A >( &state, uentry, i, lookahead, sink );
+        }
+
+        i = inext;
+    }
+
+    break_end< A >( &state, sink );
+    return i;
+}
+
+}
+
+template < unsigned A, typename Sink >
+constexpr void analyze( ual_buffer* ub, const char16_t* text, size_t size, Sink& sink )
+{
+    size_t lower = 0;
+    while ( lower < size )
+    {
+        size_t upper = detail::paragraph_breaks< A, detail::library_tables >( text, size, lower, sink );
+        sink.paragraph( lower, upper );
+
+        if constexpr ( ( A & ( script | bidi ) ) != 0 )
+        {
+            ual_analyze_paragraph( ub, text + lower, upper - lower );
+
+            // Bidi analysis uses the stack, so must come before script spans.
+            if constexpr ( ( A & bidi ) != 0 )
+            {
+                ual_analyze_bidi( ub, UAL_FROM_TEXT );
+            }
+
+            if constexpr ( ( A & script ) != 0 )
+            {
+                ual_script_span span;
+                ual_script_spans_begin( ub );
+                while ( ual_script_spans_next( ub, &span ) )
+                {
+                    sink.script_span( { lower + span.lower, lower + span.upper, span.script } );
+                }
+                ual_script_spans_end( ub );
+            }
+
+            if constexpr ( ( A & bidi ) != 0 )
+            {
+                ual_bidi_run run;
+                ual_bidi_runs_begin( ub );
+                while ( ual_bidi_runs_next( ub, &run ) )
+                {
+                    sink.bidi_run( { lower + run.lower, lower + run.upper, run.level } );
+                }
+                ual_bidi_runs_end( ub );
+            }
+        }
+
+        lower = upper;
+    }
+}
+
+template < unsigned A, typename Sink >
+constexpr void analyze( const char16_t* text, size_t size, Sink& sink )
+{
+    if constexpr ( ( A & ( script | bidi ) ) != 0 )
+    {
+        ual_buffer* ub = ual_buffer_create();
+        analyze< A >( ub, text, size, sink );
+        ual_buffer_release( ub );
+    }
+    else
+    {
+        analyze< A >( nullptr, text, size, sink );
+    }
+}
+
+}
+
+#endif
+
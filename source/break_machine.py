@@ -28,169 +28,379 @@
 #
 #       Unless there is also a matching arrow rule, enter state B.
 #
+#  With --product, build the line break and cluster break machines, and
+#  combine them into a single machine which runs both at once:
+#
+#   break_machine.py --product uax14.rules uax29p3.rules table_data.h out.h
+#
+#  The product machine is indexed by a class which merges the line break
+#  class, cluster break class, and space property of each UCDB table entry.
+#  The NU lookahead is replaced by pending states, where the decision about
+#  a break at the previous character is made once the next character is
+#  known.
+#
 
 import sys
 import os
+import re
 
-token = []
-rules = []
-rname = ''
-start = ''
 
-with open( sys.argv[ 1 ], 'r' ) as f:
-    for line in f:
+def parse_rules( path ):
 
-        # Get rid of comment.
-        comment_index = line.find( '--' )
-        if comment_index != -1:
-            line = line[:comment_index]
+    token = []
+    rules = []
+    rname = ''
+    start = ''
 
-        # Split into tokens.
-        tokens = line.split()
+    with open( path, 'r' ) as f:
+        for line in f:
 
-        # Ignore empty lines.
-        if len( tokens ) == 0:
-            continue
+            # Get rid of comment.
+            comment_index = line.find( '--' )
+            if comment_index != -1:
+                line = line[:comment_index]
 
-        # Build token list.
-        if len( tokens ) == 1 and tokens[ 0 ] != '-' and tokens[ 0 ] != 'x' and tokens[ 0 ] != '!':
-            token.append( tokens[ 0 ] )
-            continue
+            # Split into tokens.
+            tokens = line.split()
 
-        # Retain rule names.
-        if tokens[ -1 ] == ':':
-            rname = tokens[ 0 ]
-            continue
+            # Ignore empty lines.
+            if len( tokens ) == 0:
+                continue
 
-        # Check for start state.
-        if tokens[ 0 ] == '->':
-            start = tokens[ 1 ]
-            continue
+            # Build token list.
+            if len( tokens ) == 1 and tokens[ 0 ] != '-' and tokens[ 0 ] != 'x' and tokens[ 0 ] != '!':
+                token.append( tokens[ 0 ] )
+                continue
 
-        if '->' in tokens:
-            if len( tokens ) == 4:
-                # A B -> C
-                rules.append( ( rname, tokens[ 0 ], tokens[ 1 ], tokens[ 3 ] ) )
+            # Retain rule names.
+            if tokens[ -1 ] == ':':
+                rname = tokens[ 0 ]
+                continue
+
+            # Check for start state.
+            if tokens[ 0 ] == '->':
+                start = tokens[ 1 ]
+                continue
+
+            if '->' in tokens:
+                if len( tokens ) == 4:
+                    # A B -> C
+                    rules.append( ( rname, tokens[ 0 ], tokens[ 1 ], tokens[ 3 ] ) )
+                else:
+                    # A -> B
+                    rules.append( ( rname, '->', tokens[ 0 ], tokens[ 2 ] ) )
             else:
-                # A -> B
-                rules.append( ( rname, '->', tokens[ 0 ], tokens[ 2 ] ) )
-        else:
-            # Break/no-break rule.
-            i = 0
-            left = '.'
-            if tokens[ i ] != '-' and tokens[ i ] != 'x' and tokens[ i ] != '!':
-                left = tokens[ i ]
+                # Break/no-break rule.
+                i = 0
+                left = '.'
+                if tokens[ i ] != '-' and tokens[ i ] != 'x' and tokens[ i ] != '!':
+                    left = tokens[ i ]
+                    i += 1
+                action = tokens[ i ]
                 i += 1
-            action = tokens[ i ]
-            i += 1
-            right = '.'
-            if i < len( tokens ):
-                right = tokens[ i ]
-            rules.append( ( rname, left, right, action ) )
+                right = '.'
+                if i < len( tokens ):
+                    right = tokens[ i ]
+                rules.append( ( rname, left, right, action ) )
 
-states = {}
-state_list = []
-build_stack = [ start ]
-while len( build_stack ):
-    build_state = build_stack.pop()
-    if build_state in states:
-        continue
+    return token, rules, start
 
-    # Build this state by processing rules.
-    actions = []
-    for shift in token:
 
-        state = build_state
+def build_machine( token, rules, start ):
 
-        brk_action = '?'
-        next_state = shift
+    states = {}
+    state_list = []
+    build_stack = [ start ]
+    while len( build_stack ):
+        build_state = build_stack.pop()
+        if build_state in states:
+            continue
 
-        for rname, lhs, rhs, action in rules:
+        # Build this state by processing rules.
+        actions = []
+        for shift in token:
 
-            if lhs == '->':
-                action, lhs, rhs = lhs, rhs, action
+            state = build_state
 
-                if state == lhs:
-                    state = rhs
-                if shift == lhs:
-                    shift = rhs
+            brk_action = '?'
+            next_state = shift
 
-                continue
+            for rname, lhs, rhs, action in rules:
 
-            if lhs != '.' and lhs != state:
-                continue
+                if lhs == '->':
+                    action, lhs, rhs = lhs, rhs, action
 
-            if rhs != '.' and rhs != shift:
-                continue
+                    if state == lhs:
+                        state = rhs
+                    if shift == lhs:
+                        shift = rhs
 
-            if action == '-' or action == 'x' or action == '!':
-                if rhs != '.' and rhs not in token:
-                    print( "invalid token on rhs:", rhs )
-                if brk_action == '?':
-                    brk_action = action
-            else:
-                next_state = action
+                    continue
 
-        actions.append( ( brk_action, next_state ) )
-        build_stack.append( next_state )
+                if lhs != '.' and lhs != state:
+                    continue
 
-    states[ build_state ] = actions
-    state_list.append( ( [ build_state ], actions ) )
+                if rhs != '.' and rhs != shift:
+                    continue
 
-# Merge identical states.
-states = {}
+                if action == '-' or action == 'x' or action == '!':
+                    if rhs != '.' and rhs not in token:
+                        print( "invalid token on rhs:", rhs )
+                    if brk_action == '?':
+                        brk_action = action
+                else:
+                    next_state = action
 
-i = 0
-while i < len( state_list ):
-    slist, actions = state_list[ i ]
+            actions.append( ( brk_action, next_state ) )
+            build_stack.append( next_state )
 
-    j = i+1
-    while j < len( state_list ):
+        states[ build_state ] = actions
+        state_list.append( ( [ build_state ], actions ) )
 
-        s, a = state_list[ j ]
-        if a == actions:
-            slist += s
-            del state_list[ j ]
-        else:
-            j += 1
+    # Merge identical states.
+    states = {}
 
-    for state in slist:
-        states[ state ] = state_list[ i ]
+    i = 0
+    while i < len( state_list ):
+        slist, actions = state_list[ i ]
 
-    i += 1
+        j = i+1
+        while j < len( state_list ):
 
-i = 0
-for state, actions in state_list:
-    state[:] = [ i, '_'.join( state ), state[:] ]
-    i += 1
+            s, a = state_list[ j ]
+            if a == actions:
+                slist += s
+                del state_list[ j ]
+            else:
+                j += 1
 
-with open( sys.argv[ 2 ], 'w' ) as f:
-    print( "enum\n{", file=f )
-    for state, actions in state_list:
-        index, name, merged_states = state
-        print( f"    STATE_{ name } = { index },", file=f )
+        for state in slist:
+            states[ state ] = state_list[ i ]
 
-    print( "};\n", file=f )
+        i += 1
 
-    name = os.path.splitext( os.path.basename( sys.argv[ 1 ] ) )[ 0 ].upper()
-    print( f"static const ACTION { name }[ { len( state_list ) } ][ { len( token ) } ] =\n{{", file=f )
+    i = 0
     for state, actions in state_list:
-        index, name, merged_states = state
+        state[:] = [ i, '_'.join( state ), state[:] ]
+        i += 1
 
-        print( f"    /* STATE { ' '.join( merged_states ) } */\n    {{", file=f )
-        for i in range( len( token ) ):
-            allow_break, next_state = actions[ i ]
+    return state_list, states
 
-            if allow_break == '-':
-                allow_break = "BREAK"
-            elif allow_break == '!':
-                allow_break = "LOOKAHEAD_NU"
-            else:
-                allow_break = "NO_BREAK"
-            next_state = states[ next_state ][ 0 ][ 1 ]
 
-            print( f"        /* { token[ i ] } -> */ { allow_break }( STATE_{ next_state } ),", file=f )
-        print( "    },", file=f )
+def write_machine( path, name, token, state_list, states ):
+
+    with open( path, 'w' ) as f:
+        print( "enum\n{", file=f )
+        for state, actions in state_list:
+            index, sname, merged_states = state
+            print( f"    STATE_{ sname } = { index },", file=f )
+
+        print( "};\n", file=f )
+
+        print( f"static constexpr ACTION { name }[ { len( state_list ) } ][ { len( token ) } ] =\n{{", file=f )
+        for state, actions in state_list:
+            index, sname, merged_states = state
+
+            print( f"    /* STATE { ' '.join( merged_states ) } */\n    {{", file=f )
+            for i in range( len( token ) ):
+                allow_break, next_state = actions[ i ]
+
+                if allow_break == '-':
+                    allow_break = "BREAK"
+                elif allow_break == '!':
+                    allow_break = "LOOKAHEAD_NU"
+                else:
+                    allow_break = "NO_BREAK"
+                next_state = states[ next_state ][ 0 ][ 1 ]
+
+                print( f"        /* { token[ i ] } -> */ { allow_break }( STATE_{ next_state } ),", file=f )
+            print( "    },", file=f )
 
-    print( "};\n", file=f )
+        print( "};\n", file=f )
+
+
+def load_machine( path ):
+
+    token, rules, start = parse_rules( path )
+    state_list, states = build_machine( token, rules, start )
+    return token, state_list, states, start
+
+
+#
+#  Product machine.
+#
+
+PRODUCT_CLUSTER     = 1 << 0    # UAL_BREAK_CLUSTER at this character.
+PRODUCT_LINE        = 1 << 1    # UAL_BREAK_LINE at this character.
+PRODUCT_OPPORTUNITY = 1 << 2    # break opportunity (possibly pending).
+PRODUCT_SPACE       = 1 << 3    # this character is a space.
+PRODUCT_DEFER_LINE  = 1 << 4    # UAL_BREAK_LINE at previous character.
+PRODUCT_SKIP        = 1 << 5    # low surrogate.
+PRODUCT_STATE_SHIFT = 6
+
+
+def load_entries( path ):
+
+    # Read line break class, zspace, and cluster break class of each entry.
+    entries = []
+    pattern = re.compile( r'\s*\{ UCDB_SCRIPT_\w+, UCDB_BIDI_\w+, UCDB_LBREAK_(\w+), (true|false), UCDB_CBREAK_(\w+), (true|false) \},' )
+    with open( path, 'r' ) as f:
+        for line in f:
+            if line.startswith( '};' ) and entries:
+                break
+            match = pattern.match( line )
+            if match:
+                entries.append( ( match.group( 1 ), match.group( 3 ), match.group( 2 ) == 'true' ) )
+    return entries
+
+
+def machine_action( machine, state, shift ):
+
+    # Returns break action and index of next merged state.
+    token, state_list, states, start = machine
+    allow_break, next_state = state_list[ state ][ 1 ][ token.index( shift ) ]
+    return allow_break, states[ next_state ][ 0 ][ 0 ]
+
+
+def build_product( lb, cb, entries ):
+
+    # Classes are the distinct combinations of properties, plus skip.
+    classes = sorted( set( entries ) )
+    hard_state = lb[ 2 ][ 'BK' ][ 0 ][ 0 ]
+
+    lb_start = lb[ 2 ][ lb[ 3 ] ][ 0 ][ 0 ]
+    cb_start = cb[ 2 ][ cb[ 3 ] ][ 0 ][ 0 ]
+
+    # Product states are ( lb state, cb state, pending ).
+    start = ( lb_start, cb_start, False )
+    index = { start : 0 }
+    rows = []
+    build_list = [ start ]
+    while len( rows ) < len( build_list ):
+        lb_state, cb_state, pending = build_list[ len( rows ) ]
+
+        row = []
+        for lb_class, cb_class, zspace in classes:
+            lb_break, lb_next = machine_action( lb, lb_state, lb_class )
+            cb_break, cb_next = machine_action( cb, cb_state, cb_class )
+
+            flags = 0
+            if cb_break == '-':
+                flags |= PRODUCT_CLUSTER
+            if lb_break == '-':
+                flags |= PRODUCT_LINE
+            if lb_break == '-' or lb_break == '!':
+                flags |= PRODUCT_OPPORTUNITY
+            if zspace or lb_class == 'ZW' or lb_next == hard_state:
+                flags |= PRODUCT_SPACE
+            if pending and lb_class != 'NU':
+                flags |= PRODUCT_DEFER_LINE
+
+            next_state = ( lb_next, cb_next, lb_break == '!' )
+            if next_state not in index:
+                index[ next_state ] = len( build_list )
+                build_list.append( next_state )
+            row.append( ( flags, index[ next_state ] ) )
+
+        rows.append( row )
+
+    pending = [ state[ 2 ] for state in build_list ]
+
+    # Merge equivalent states until nothing changes.
+    while True:
+        keys = {}
+        remap = []
+        for i in range( len( rows ) ):
+            key = ( pending[ i ], tuple( rows[ i ] ) )
+            if key not in keys:
+                keys[ key ] = len( keys )
+            remap.append( keys[ key ] )
+
+        if len( keys ) == len( rows ):
+            break
+
+        merged_rows = [ None ] * len( keys )
+        merged_pending = [ None ] * len( keys )
+        for i in range( len( rows ) ):
+            merged_rows[ remap[ i ] ] = [ ( flags, remap[ next_state ] ) for flags, next_state in rows[ i ] ]
+            merged_pending[ remap[ i ] ] = pending[ i ]
+        rows = merged_rows
+        pending = merged_pending
+
+    # Merge classes which behave identically in every state.
+    columns = {}
+    class_map = {}
+    for j in range( len( classes ) ):
+        column = tuple( row[ j ] for row in rows )
+        if column not in columns:
+            columns[ column ] = len( columns )
+        class_map[ classes[ j ] ] = columns[ column ]
+
+    table = []
+    for row in rows:
+        merged = [ None ] * len( columns )
+        for j in range( len( classes ) ):
+            merged[ class_map[ classes[ j ] ] ] = row[ j ]
+        table.append( merged )
+
+    # Add skip class, which keeps the current state.
+    skip_class = len( columns )
+    for i in range( len( table ) ):
+        table[ i ].append( ( PRODUCT_SKIP, i ) )
+
+    entry_classes = [ class_map[ entry ] for entry in entries ] + [ skip_class ]
+    return table, pending, entry_classes
+
+
+def write_product( path, table, pending, entry_classes ):
+
+    state_count = len( table )
+    class_count = len( table[ 0 ] )
+    if state_count << PRODUCT_STATE_SHIFT > 0xFFFF:
+        print( "product machine has too many states:", state_count )
+        sys.exit( 1 )
+
+    with open( path, 'w' ) as f:
+        print( f"const unsigned PRODUCT_CLUSTER = { PRODUCT_CLUSTER };", file=f )
+        print( f"const unsigned PRODUCT_LINE = { PRODUCT_LINE };", file=f )
+        print( f"const unsigned PRODUCT_OPPORTUNITY = { PRODUCT_OPPORTUNITY };", file=f )
+        print( f"const unsigned PRODUCT_SPACE = { PRODUCT_SPACE };", file=f )
+        print( f"const unsigned PRODUCT_DEFER_LINE = { PRODUCT_DEFER_LINE };", file=f )
+        print( f"const unsigned PRODUCT_SKIP = { PRODUCT_SKIP };", file=f )
+        print( f"const unsigned PRODUCT_STATE_SHIFT = { PRODUCT_STATE_SHIFT };", file=f )
+        print( f"const unsigned PRODUCT_START = 0;", file=f )
+        print( f"const size_t PRODUCT_ENTRY_COUNT = { len( entry_classes ) - 1 };\n", file=f )
+
+        print( f"static const uint8_t PRODUCT_CLASS[ { len( entry_classes ) } ] =\n{{", file=f )
+        for i in range( 0, len( entry_classes ), 16 ):
+            print( "    " + " ".join( f"{ c }," for c in entry_classes[ i : i + 16 ] ), file=f )
+        print( "};\n", file=f )
+
+        print( f"static const bool PRODUCT_PENDING[ { state_count } ] =\n{{", file=f )
+        for i in range( 0, state_count, 8 ):
+            print( "    " + " ".join( "true," if p else "false," for p in pending[ i : i + 8 ] ), file=f )
+        print( "};\n", file=f )
+
+        print( f"static const uint16_t PRODUCT[ { state_count } ][ { class_count } ] =\n{{", file=f )
+        for i in range( state_count ):
+            print( f"    /* STATE { i }{ ' PENDING' if pending[ i ] else '' } */\n    {{", file=f )
+            for j in range( 0, class_count, 8 ):
+                print( "        " + " ".join( f"0x{ ( next_state << PRODUCT_STATE_SHIFT ) | flags :04X}," for flags, next_state in table[ i ][ j : j + 8 ] ), file=f )
+            print( "    },", file=f )
+        print( "};\n", file=f )
+
+
+if len( sys.argv ) > 1 and sys.argv[ 1 ] == '--product':
+
+    lb = load_machine( sys.argv[ 2 ] )
+    cb = load_machine( sys.argv[ 3 ] )
+    entries = load_entries( sys.argv[ 4 ] )
+    table, pending, entry_classes = build_product( lb, cb, entries )
+    write_product( sys.argv[ 5 ], table, pending, entry_classes )
+
+else:
+
+    token, state_list, states, start = load_machine( sys.argv[ 1 ] )
+    name = os.path.splitext( os.path.basename( sys.argv[ 1 ] ) )[ 0 ].upper()
+    write_machine( sys.argv[ 2 ], name, token, state_list, states )
 
@@ -0,0 +1,405 @@
+//
+//  ual_archive.cpp
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include "ualyze.h"
+#include <assert.h>
+#include <string.h>
+#include "ual_buffer.h"
+#include "ucdb_script.h"
+
+/*
+    The header and table have fixed layouts so that any paragraph can be
+    found without reading the others.  Within a paragraph, the sections are:
+
+      - breaks: for each of the cluster, line, and spaces lists, a varint
+        count and a varint size in bytes, followed by the positions as varint
+        differences, as with UAL_OPTION_BREAK_VARINT.
+      - scripts: a varint count, then for each span a varint length and a
+        32-bit script code.
+      - bidi: a varint count, then for each run a varint length and an 8-bit
+        level.
+
+    The format does not depend on UAL_WIDE, so paragraph lengths and section
+    sizes are limited to 32 bits.
+*/
+
+const uint8_t ARCHIVE_MAGIC[ 4 ] = { 'U', 'A', 'L', 'Z' };
+const size_t ARCHIVE_HEADER_SIZE = 16;
+const size_t ARCHIVE_ENTRY_SIZE = 40;
+
+struct ual_archive_entry
+{
+    uint64_t data_offset;
+    uint64_t text_offset;
+    uint32_t length;
+    uint32_t break_size;
+    uint32_t script_size;
+    uint32_t bidi_size;
+    uint8_t paragraph_level;
+};
+
+struct ual_archive_writer
+{
+    intptr_t refcount;
+    uint64_t text_offset;
+    std::vector< ual_archive_entry > entries;
+    std::vector< uint8_t > data;
+    std::vector< uint8_t > items;
+    std::vector< uint8_t > archive;
+};
+
+static void archive_put( std::vector< uint8_t >* out, uint64_t value, size_t bytes )
+{
+    for ( size_t i = 0; i < bytes; ++i )
+    {
+        out->push_back( (uint8_t)( value >> ( i * 8 ) ) );
+    }
+}
+
+static uint64_t archive_get( const uint8_t* p, size_t bytes )
+{
+    uint64_t value = 0;
+    for ( size_t i = 0; i < bytes; ++i )
+    {
+        value |= (uint64_t)p[ i ] << ( i * 8 );
+    }
+    return value;
+}
+
+static bool archive_varint( const uint8_t** p, const uint8_t* end, size_t* out_value )
+{
+    // Read a varint which must end before the end of the section.
+    size_t value = 0;
+    for ( unsigned shift = 0; *p < end && shift < sizeof( size_t ) * 8; shift += 7 )
+    {
+        uint8_t byte = *( *p )++;
+        value |= (size_t)( byte & 0x7F ) << shift;
+        if ( ! ( byte & 0x80 ) )
+        {
+            *out_value = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+    Writer.
+*/
+
+UAL_API ual_archive_writer* ual_archive_writer_create()
+{
+    ual_archive_writer* aw = new ual_archive_writer();
+    aw->refcount = 1;
+    aw->text_offset = 0;
+    return aw;
+}
+
+UAL_API ual_archive_writer* ual_archive_writer_retain( ual_archive_writer* aw )
+{
+    ++aw->refcount;
+    return aw;
+}
+
+UAL_API void ual_archive_writer_release( ual_archive_writer* aw )
+{
+    if ( aw && --aw->refcount == 0 )
+    {
+        delete aw;
+    }
+}
+
+UAL_API void ual_archive_writer_add( ual_archive_writer* aw, ual_buffer* ub, unsigned override_paragraph_level )
+{
+    ual_archive_entry entry = {};
+    entry.data_offset = aw->data.size();
+    entry.text_offset = aw->text_offset;
+    assert( ub->c.size() <= UINT32_MAX );
+    entry.length = (uint32_t)ub->c.size();
+    aw->text_offset += ub->c.size();
+
+    // Break lists, encoded by break analysis.
+    size_t lower = aw->data.size();
+    unsigned options = ub->options;
+    ual_buffer_options( ub, UAL_OPTION_BREAK_VARINT );
+    ual_analyze_breaks( ub );
+    ual_buffer_options( ub, options );
+    for ( uint16_t break_flag : { UAL_BREAK_CLUSTER, UAL_BREAK_LINE, UAL_BREAK_SPACES } )
+    {
+        ual_break_list list;
+        ual_break_list_get( ub, break_flag, &list );
+        push_varint( &aw->data, list.count );
+        push_varint( &aw->data, list.varint_size );
+        aw->data.insert( aw->data.end(), list.varint, list.varint + list.varint_size );
+    }
+    assert( aw->data.size() - lower <= UINT32_MAX );
+    entry.break_size = (uint32_t)( aw->data.size() - lower );
+
+    // Script spans.
+    lower = aw->data.size();
+    aw->items.clear();
+    size_t count = 0;
+    ual_script_span span;
+    ual_script_spans_begin( ub );
+    while ( ual_script_spans_next( ub, &span ) )
+    {
+        push_varint( &aw->items, span.upper - span.lower );
+        archive_put( &aw->items, span.script, 4 );
+        count += 1;
+    }
+    ual_script_spans_end( ub );
+    push_varint( &aw->data, count );
+    aw->data.insert( aw->data.end(), aw->items.begin(), aw->items.end() );
+    assert( aw->data.size() - lower <= UINT32_MAX );
+    entry.script_size = (uint32_t)( aw->data.size() - lower );
+
+    // Bidi runs.
+    lower = aw->data.size();
+    aw->items.clear();
+    count = 0;
+    entry.paragraph_level = (uint8_t)ual_analyze_bidi( ub, override_paragraph_level );
+    ual_bidi_run run;
+    ual_bidi_runs_begin( ub );
+    while ( ual_bidi_runs_next( ub, &run ) )
+    {
+        push_varint( &aw->items, run.upper - run.lower );
+        aw->items.push_back( (uint8_t)run.level );
+        count += 1;
+    }
+    ual_bidi_runs_end( ub );
+    push_varint( &aw->data, count );
+    aw->data.insert( aw->data.end(), aw->items.begin(), aw->items.end() );
+    assert( aw->data.size() - lower <= UINT32_MAX );
+    entry.bidi_size = (uint32_t)( aw->data.size() - lower );
+
+    aw->entries.push_back( entry );
+    aw->archive.clear();
+}
+
+UAL_API const void* ual_archive_writer_data( ual_archive_writer* aw, size_t* out_size )
+{
+    if ( aw->archive.empty() )
+    {
+        // Header.
+        std::vector< uint8_t >* out = &aw->archive;
+        out->insert( out->end(), ARCHIVE_MAGIC, ARCHIVE_MAGIC + sizeof( ARCHIVE_MAGIC ) );
+        archive_put( out, UAL_ARCHIVE_VERSION, 2 );
+        archive_put( out, 0, 2 );
+        archive_put( out, aw->entries.size(), 8 );
+
+        // Table, with data offsets from the start of the archive.
+        uint64_t data_start = ARCHIVE_HEADER_SIZE + aw->entries.size() * ARCHIVE_ENTRY_SIZE;
+        for ( const ual_archive_entry& entry : aw->entries )
+        {
+            archive_put( out, data_start + entry.data_offset, 8 );
+            archive_put( out, entry.text_offset, 8 );
+            archive_put( out, entry.length, 4 );
+            archive_put( out, entry.break_size, 4 );
+            archive_put( out, entry.script_size, 4 );
+            archive_put( out, entry.bidi_size, 4 );
+            archive_put( out, entry.paragraph_level, 1 );
+            archive_put( out, 0, 7 );
+        }
+
+        // Data.
+        assert( out->size() == data_start );
+        out->insert( out->end(), aw->data.begin(), aw->data.end() );
+    }
+
+    *out_size = aw->archive.size();
+    return aw->archive.data();
+}
+
+/*
+    Reader.  Nothing is copied out of the archive.
+*/
+
+UAL_API bool ual_archive_open( ual_archive* archive, const void* data, size_t size )
+{
+    *archive = { nullptr, 0, 0 };
+
+    const uint8_t* p = (const uint8_t*)data;
+    if ( size < ARCHIVE_HEADER_SIZE || memcmp( p, ARCHIVE_MAGIC, sizeof( ARCHIVE_MAGIC ) ) != 0 )
+    {
+        return false;
+    }
+
+    if ( archive_get( p + 4, 2 ) != UAL_ARCHIVE_VERSION )
+    {
+        return false;
+    }
+
+    uint64_t count = archive_get( p + 8, 8 );
+    if ( count > ( size - ARCHIVE_HEADER_SIZE ) / ARCHIVE_ENTRY_SIZE )
+    {
+        return false;
+    }
+
+    *archive = { p, size, (size_t)count };
+    return true;
+}
+
+UAL_API bool ual_archive_paragraph_get( const ual_archive* archive, size_t index, ual_archive_paragraph* out_paragraph )
+{
+    *out_paragraph = { 0, 0, 0, nullptr, nullptr, nullptr, 0, 0, 0 };
+    if ( index >= archive->paragraph_count )
+    {
+        return false;
+    }
+
+    // Check that the sections are inside the archive.
+    const uint8_t* p = archive->data + ARCHIVE_HEADER_SIZE + index * ARCHIVE_ENTRY_SIZE;
+    uint64_t data_offset = archive_get( p, 8 );
+    uint64_t break_size = archive_get( p + 20, 4 );
+    uint64_t script_size = archive_get( p + 24, 4 );
+    uint64_t bidi_size = archive_get( p + 28, 4 );
+    if ( data_offset > archive->size || break_size + script_size + bidi_size > archive->size - data_offset )
+    {
+        return false;
+    }
+
+    const uint8_t* section = archive->data + data_offset;
+    out_paragraph->text_offset = archive_get( p + 8, 8 );
+    out_paragraph->length = archive_get( p + 16, 4 );
+    out_paragraph->paragraph_level = p[ 32 ];
+    out_paragraph->breaks = break_size ? section : nullptr;
+    out_paragraph->scripts = script_size ? section + break_size : nullptr;
+    out_paragraph->bidi = bidi_size ? section + break_size + script_size : nullptr;
+    out_paragraph->break_size = break_size;
+    out_paragraph->script_size = script_size;
+    out_paragraph->bidi_size = bidi_size;
+    return true;
+}
+
+UAL_API bool ual_archive_break_list_get( const ual_archive_paragraph* ap, uint16_t break_flag, ual_break_list* out_list )
+{
+    *out_list = { 0, nullptr, nullptr, 0 };
+    if ( ! ap->breaks )
+    {
+        return false;
+    }
+
+    // Skip lists before the list for this flag.
+    const uint8_t* p = ap->breaks;
+    const uint8_t* end = ap->breaks + ap->break_size;
+    for ( uint16_t flag : { UAL_BREAK_CLUSTER, UAL_BREAK_LINE, UAL_BREAK_SPACES } )
+    {
+        size_t count = 0, size = 0;
+        if ( ! archive_varint( &p, end, &count ) || ! archive_varint( &p, end, &size ) || size > (size_t)( end - p ) )
+        {
+            return false;
+        }
+
+        if ( flag != break_flag )
+        {
+            p += size;
+            continue;
+        }
+
+        // Check that decoding the positions stays inside the list.
+        const uint8_t* q = p;
+        for ( size_t i = 0; i < count; ++i )
+        {
+            size_t delta = 0;
+            if ( ! archive_varint( &q, p + size, &delta ) )
+            {
+                return false;
+            }
+        }
+
+        out_list->count = count;
+        out_list->varint = p;
+        out_list->varint_size = size;
+        return true;
+    }
+
+    return false;
+}
+
+UAL_API void ual_archive_script_spans_begin( const ual_archive_paragraph* ap, ual_archive_iterator* it )
+{
+    it->p = ap->scripts;
+    it->end = ap->scripts + ap->script_size;
+    it->count = 0;
+    if ( ap->scripts && ! archive_varint( &it->p, it->end, &it->count ) )
+    {
+        it->count = 0;
+    }
+    it->index = 0;
+    it->length = ap->length;
+    it->paragraph_level = ap->paragraph_level;
+}
+
+UAL_API bool ual_archive_script_spans_next( ual_archive_iterator* it, ual_script_span* out_span )
+{
+    out_span->lower = it->index;
+    if ( ! it->count )
+    {
+        out_span->upper = it->index;
+        out_span->script = UCDB_SCRIPT_CODE[ UCDB_SCRIPT_LATIN ];
+        return false;
+    }
+
+    // Stop at a span which overruns the section or the paragraph.
+    size_t length = 0;
+    if ( ! archive_varint( &it->p, it->end, &length ) || it->end - it->p < 4 || length > it->length - it->index )
+    {
+        it->count = 0;
+        out_span->upper = it->index;
+        out_span->script = UCDB_SCRIPT_CODE[ UCDB_SCRIPT_LATIN ];
+        return false;
+    }
+
+    it->index += length;
+    out_span->upper = it->index;
+    out_span->script = (uint32_t)archive_get( it->p, 4 );
+    it->p += 4;
+    it->count -= 1;
+    return true;
+}
+
+UAL_API void ual_archive_bidi_runs_begin( const ual_archive_paragraph* ap, ual_archive_iterator* it )
+{
+    it->p = ap->bidi;
+    it->end = ap->bidi + ap->bidi_size;
+    it->count = 0;
+    if ( ap->bidi && ! archive_varint( &it->p, it->end, &it->count ) )
+    {
+        it->count = 0;
+    }
+    it->index = 0;
+    it->length = ap->length;
+    it->paragraph_level = ap->paragraph_level;
+}
+
+UAL_API bool ual_archive_bidi_runs_next( ual_archive_iterator* it, ual_bidi_run* out_run )
+{
+    // Stop at a run which overruns the section or the paragraph.
+    size_t length = 0;
+    if ( it->count && ( ! archive_varint( &it->p, it->end, &length ) || it->p == it->end || length > it->length - it->index ) )
+    {
+        it->count = 0;
+    }
+
+    if ( ! it->count )
+    {
+        out_run->lower = it->length;
+        out_run->upper = it->length;
+        out_run->level = it->paragraph_level;
+        return false;
+    }
+
+    out_run->lower = it->index;
+    it->index += length;
+    out_run->upper = it->index;
+    out_run->level = *it->p++;
+    it->count -= 1;
+    return true;
+}
@@ -10,8 +10,17 @@
 
 #include "ualyze.h"
 #include <assert.h>
+#include <string.h>
+#include <algorithm>
 #include "ual_buffer.h"
 #include "ucdb_bracket.h"
+#include "ualyze_template.h"
+
+/*
+    Include state machine for weak types.
+*/
+
+#include "uax9weak.h"
 
 /*
     sos/eos types.  BC_SEQUENCE represents a link to next/previous run in the
@@ -79,7 +88,10 @@ static void debug_print_bidi( ual_buffer* ub )
     switch ( ub->bidi_analysis.complexity )
     {
     case BIDI_ALL_LEFT: printf( "BIDI_COMPLEXITY ALL_LEFT\n" ); break;
+    case BIDI_ALL_RIGHT: printf( "BIDI_COMPLEXITY ALL_RIGHT\n" ); break;
+    case BIDI_STRONG: printf( "BIDI_COMPLEXITY STRONG\n" ); break;
     case BIDI_SOLITARY: printf( "BIDI_COMPLEXITY SOLITARY\n" ); break;
+    case BIDI_ISOLATES: printf( "BIDI_COMPLEXITY ISOLATES\n" ); break;
     case BIDI_EXPLICIT: printf( "BIDI_COMPLEXITY EXPLICIT\n" ); break;
     }
 
@@ -102,12 +114,67 @@ static void debug_print_bidi( ual_buffer* ub )
 /*
     Look up bidi classes for each codepoint in a paragraph.  The class of
     each codepoint is modified by later stages of the algorithm.
+
+    The set of classes present determines how much of the algorithm is
+    required.  A paragraph with no right-to-left characters is entirely at
+    level 0.  A paragraph with right-to-left characters, but no left-to-right
+    characters, numbers, or explicit formatting is entirely at level 1.  A
+    paragraph containing only strong characters and whitespace needs no weak
+    or bracket resolution.  A paragraph whose only explicit formatting is
+    isolates does not need the full directional status stack.
 */
 
+static constexpr uint32_t bidi_set( unsigned bc )
+{
+    return (uint32_t)1 << bc;
+}
+
+const uint32_t BIDI_SET_RIGHT = bidi_set( UCDB_BIDI_R ) | bidi_set( UCDB_BIDI_AL ) | bidi_set( UCDB_BIDI_AN );
+const uint32_t BIDI_SET_LEFT = bidi_set( UCDB_BIDI_L ) | bidi_set( UCDB_BIDI_EN ) | bidi_set( UCDB_BIDI_AN );
+const uint32_t BIDI_SET_EXPLICIT =
+      bidi_set( UCDB_BIDI_LRE ) | bidi_set( UCDB_BIDI_LRO ) | bidi_set( UCDB_BIDI_RLE ) | bidi_set( UCDB_BIDI_RLO )
+    | bidi_set( UCDB_BIDI_PDF ) | bidi_set( UCDB_BIDI_LRI ) | bidi_set( UCDB_BIDI_RLI ) | bidi_set( UCDB_BIDI_FSI )
+    | bidi_set( UCDB_BIDI_PDI );
+const uint32_t BIDI_SET_ISOLATE =
+      bidi_set( UCDB_BIDI_LRI ) | bidi_set( UCDB_BIDI_RLI ) | bidi_set( UCDB_BIDI_FSI ) | bidi_set( UCDB_BIDI_PDI );
+const uint32_t BIDI_SET_STRONG =
+      bidi_set( UCDB_BIDI_L ) | bidi_set( UCDB_BIDI_R ) | bidi_set( UCDB_BIDI_AL ) | bidi_set( UCDB_BIDI_WS )
+    | bidi_set( UCDB_BIDI_S ) | bidi_set( UCDB_BIDI_B ) | bidi_set( UCDB_BIDI_BN ) | bidi_set( BC_INVALID );
+
+ual_bidi_complexity bidi_classify( uint32_t classes )
+{
+    if ( ! ( classes & ( BIDI_SET_RIGHT | BIDI_SET_EXPLICIT ) ) )
+        return BIDI_ALL_LEFT;
+    else if ( classes & ( BIDI_SET_EXPLICIT & ~BIDI_SET_ISOLATE ) )
+        return BIDI_EXPLICIT;
+    else if ( classes & BIDI_SET_ISOLATE )
+        return BIDI_ISOLATES;
+    else if ( ! ( classes & BIDI_SET_LEFT ) )
+        return BIDI_ALL_RIGHT;
+    else if ( ! ( classes & ~BIDI_SET_STRONG ) )
+        return BIDI_STRONG;
+    else
+        return BIDI_SOLITARY;
+}
+
 static ual_bidi_complexity bidi_lookup( ual_buffer* ub )
 {
-    bool left = true;
-    bool solitary = true;
+    // Classes looked up by ual_analyze_all only need to be copied.
+    if ( ub->bidi_classes.valid )
+    {
+        ual_char* c = ub->c.data();
+        const uint8_t* classes = ub->bidi_classes.classes.data();
+        size_t length = ub->c.size();
+        for ( size_t index = 0; index < length; ++index )
+        {
+            c[ index ].bc = classes[ index ];
+        }
+
+        ub->bc_usage = BC_BIDI_CLASS;
+        return ub->bidi_classes.complexity;
+    }
+
+    uint32_t classes = 0;
 
     size_t length = ub->c.size();
     for ( size_t index = 0; index < length; ++index )
@@ -119,50 +186,16 @@ static ual_bidi_complexity bidi_lookup( ual_buffer* ub )
             continue;
         }
 
-        const ucdb_entry& uentry = UCDB_TABLE[ c.ix ];
-        unsigned bc = uentry.bclass;
+        unsigned bc = bidi_initial_class( UCDB_TABLE[ c.ix ] );
         c.bc = bc;
-
-        switch ( bc )
-        {
-        case UCDB_BIDI_R:
-        case UCDB_BIDI_AL:
-        case UCDB_BIDI_AN:
-            left = false;
-            break;
-
-        case UCDB_BIDI_LRE:
-        case UCDB_BIDI_LRO:
-        case UCDB_BIDI_RLE:
-        case UCDB_BIDI_RLO:
-        case UCDB_BIDI_PDF:
-        case UCDB_BIDI_LRI:
-        case UCDB_BIDI_RLI:
-        case UCDB_BIDI_FSI:
-        case UCDB_BIDI_PDI:
-            left = false;
-            solitary = false;
-            break;
-
-        case UCDB_BIDI_ON:
-            if ( uentry.paired )
-            {
-                c.bc = BC_BRACKET;
-            }
-            break;
-        }
+        classes |= bidi_set( bc );
     }
 
     ub->bc_usage = BC_BIDI_CLASS;
 
     //debug_print_bidi( ub );
 
-    if ( left )
-        return BIDI_ALL_LEFT;
-    else if ( solitary )
-        return BIDI_SOLITARY;
-    else
-        return BIDI_EXPLICIT;
+    return bidi_classify( classes );
 }
 
 /*
@@ -202,7 +235,7 @@ static unsigned bidi_solitary( ual_buffer* ub, unsigned override_paragraph_level
     }
 
     ub->level_runs.push_back( { 0, paragraph_level, boundary_class, boundary_class, 0 } );
-    ub->level_runs.push_back( { (unsigned)length, paragraph_level, BC_SEQUENCE, BC_SEQUENCE, 0 } );
+    ub->level_runs.push_back( { (ual_index)length, paragraph_level, BC_SEQUENCE, BC_SEQUENCE, 0 } );
     return paragraph_level;
 }
 
@@ -217,7 +250,7 @@ static unsigned bidi_solitary( ual_buffer* ub, unsigned override_paragraph_level
 const unsigned BIDI_MAX_DEPTH = 125;
 const size_t BIDI_EXSTACK_LIMIT = BIDI_MAX_DEPTH + 2;
 
-const unsigned BIDI_INVALID_LEVEL_RUN = 0xFFFFF;
+const unsigned BIDI_INVALID_LEVEL_RUN = LINK_INVALID;
 
 enum ual_bidi_override_isolate
 {
@@ -229,9 +262,9 @@ enum ual_bidi_override_isolate
 
 struct ual_bidi_exentry
 {
-    unsigned level  : 8;    // bidi level.
-    unsigned oi     : 4;    // override or isolate status.
-    unsigned iprev  : 20;   // index of previous level run (for BIDI_ISOLATE).
+    unsigned level  : 8;            // bidi level.
+    unsigned oi     : 4;            // override or isolate status.
+    unsigned iprev  : LINK_BITS;    // index of previous level run (for BIDI_ISOLATE).
 };
 
 struct ual_bidi_exstack
@@ -261,6 +294,7 @@ static unsigned first_strong_level( ual_buffer* ub, size_t index, bool fsi )
     size_t length = ub->c.size();
     while ( index < length )
     {
+        stats_add( ub->stats.lookahead, 1 );
         unsigned bc = ub->c[ index++ ].bc;
         switch ( bc )
         {
@@ -344,7 +378,7 @@ static unsigned bidi_explicit( ual_buffer* ub, unsigned override_paragraph_level
     size_t valid_isolate_count = 0;
 
     // We are at the start of the string.
-    unsigned run_start = 0;
+    ual_index run_start = 0;
     unsigned run_level = paragraph_level;
     unsigned run_sos = boundary_class( paragraph_level, paragraph_level );
     size_t run_isolate_count = 0;
@@ -580,7 +614,7 @@ static unsigned bidi_explicit( ual_buffer* ub, unsigned override_paragraph_level
             unsigned level = next_level( stack_entry.level, bc == UCDB_BIDI_RLI );
 
             // Check for overflow isolate.
-            if ( level > BIDI_MAX_DEPTH || overflow_embedding_count > 0 || overflow_embedding_count > 0 )
+            if ( level > BIDI_MAX_DEPTH || overflow_isolate_count > 0 || overflow_embedding_count > 0 )
             {
                 // Increment the overflow isolate count by one, and leave all
                 // other variables unchanged.
@@ -644,263 +678,267 @@ static unsigned bidi_explicit( ual_buffer* ub, unsigned override_paragraph_level
     }
 
     // Add a final 'run' to simplify lookup of level runs.
-    ub->level_runs.push_back( { (unsigned)index, paragraph_level, BC_SEQUENCE, BC_SEQUENCE, 0 } );
+    ub->level_runs.push_back( { (ual_index)index, paragraph_level, BC_SEQUENCE, BC_SEQUENCE, 0 } );
 
     // Done.
     return paragraph_level;
 }
 
 /*
-    Perform rules W1 to W7 on the characters in each level run.
-
-    We make a single pass through the string.  This works because:
-
-        - Level runs in an isolating run sequence which do not terminate the
-          isolating run sequence must end with an isolate initiator.
-        - Level runs in an isolating run sequence which continue the isolating
-          run sequence must begin with a PDI.
-        - Neither isolate initiators nor PDI are removed by rule X9.
-        - Therefore the lookahead in rule W5 must terminate before or at the
-          end of a single level run.
+    In a string where the only explicit formatting characters are isolate
+    initiators and PDIs, perform rules X1 to X10 in a single scan.  With no
+    embeddings or overrides, every entry on the directional status stack is an
+    isolate, no classes are overridden, and no characters are removed.  Level
+    runs change only after an isolate initiator or at a matching PDI.
 
-    Both rule W2 and rule W7 require the type of the previous strong character.
-    No weak rule changes the previous strong type - W1 changes the current
-    character to the previous one, while W3 is super-predictable.  Therefore
-    we can keep track of the previous strong type and hand it over to the next
-    level run in the isolating run sequence.
+    Return the paragraph embedding level.
 */
 
-void bidi_weak( ual_buffer* ub )
+const uint32_t BIDI_SET_ISOLATE_SCAN =
+    BIDI_SET_ISOLATE | bidi_set( UCDB_BIDI_B ) | bidi_set( UCDB_BIDI_BN ) | bidi_set( BC_INVALID );
+
+static unsigned bidi_isolates( ual_buffer* ub, unsigned override_paragraph_level )
 {
-    size_t length = ub->level_runs.size() - 1;
-    for ( size_t i = 0; i < length; ++i )
-    {
-        ual_level_run* prun = &ub->level_runs[ i ];
-        ual_level_run* nrun = &ub->level_runs[ i + 1 ];
+    ub->level_runs.clear();
 
-        // Previous strong class.
-        unsigned prev_strong = prun->sos;
+    // Create stack.  Entries have the level of the isolate and the index of
+    // the level run containing its initiator.
+    ual_bidi_exstack stack = make_exstack( ub );
 
-        // Previous classes after dealing with NSMs
-        unsigned prev_w1 = prun->sos;
+    // Calculate paragraph embedding level.
+    unsigned paragraph_level = 0;
+    if ( override_paragraph_level == UAL_FROM_TEXT )
+    {
+        paragraph_level = first_strong_level( ub, 0, false );
+    }
+    else
+    {
+        paragraph_level = override_paragraph_level;
+    }
 
-        // Index of separator and class of number preceding it.
-        enum { NONE, MATCH_EN, MATCH_EN_XS, MATCH_AN, MATCH_AN_CS } state_w4 = NONE;
-        size_t index_w4 = INVALID_INDEX;
+    // Isolate state.
+    unsigned level = paragraph_level;
+    size_t overflow_isolate_count = 0;
 
-        // Index of first ET in sequence to be updated if we encounter an EN.
-        unsigned prev_w5 = prun->sos;
-        size_t index_w5 = INVALID_INDEX;
+    // We are at the start of the string.
+    ual_index run_start = 0;
+    unsigned run_level = paragraph_level;
+    unsigned run_sos = boundary_class( paragraph_level, paragraph_level );
+    size_t run_isolate_count = 0;
 
-        // Update each of the characters in the run.
-        for ( size_t i = prun->start; i < nrun->start; ++i )
+    size_t index = 0;
+    size_t length = ub->c.size();
+    for ( ; index < length; ++index )
+    {
+        unsigned bc = ub->c[ index ].bc;
+        if ( bidi_set( bc ) & BIDI_SET_ISOLATE_SCAN )
         {
-            ual_char& c = ub->c[ i ];
-            if ( c.bc == BC_INVALID || c.bc == UCDB_BIDI_BN )
+            if ( bc == UCDB_BIDI_BN || bc == BC_INVALID )
             {
                 continue;
             }
 
-            // W1. Update class of NSM to class of previous.  We leave NSM
-            // sequences that follow an BRACKET as NSMs, since rule N0 needs to
-            // differentiate them.
-            if ( c.bc == UCDB_BIDI_NSM )
+            if ( bc == UCDB_BIDI_B )
             {
-                if ( prev_w1 != BC_BRACKET
-                    && prev_w1 != UCDB_BIDI_FSI
-                    && prev_w1 != UCDB_BIDI_LRI
-                    && prev_w1 != UCDB_BIDI_RLI
-                    && prev_w1 != UCDB_BIDI_PDI )
-                {
-                    c.bc = prev_w1;
-                }
-                else if ( prev_w1 != BC_BRACKET )
-                {
-                    c.bc = UCDB_BIDI_ON;
-                }
+                break;
             }
 
-            prev_w1 = c.bc;
-
-            // W2. Keep track of strong left context.  Change EN to AN if
-            // the strong left context is AL.
-            if ( c.bc == UCDB_BIDI_R || c.bc == UCDB_BIDI_L || c.bc == UCDB_BIDI_AL )
+            if ( bc == UCDB_BIDI_PDI && overflow_isolate_count > 0 )
             {
-                prev_strong = c.bc;
-            }
-            if ( c.bc == UCDB_BIDI_EN && prev_strong == UCDB_BIDI_AL )
-            {
-                c.bc = UCDB_BIDI_AN;
+                // This PDI matches an overflow isolate initiator.
+                overflow_isolate_count -= 1;
             }
-
-            // W3. Change AL to R.
-            if ( c.bc == UCDB_BIDI_AL )
+            else if ( bc == UCDB_BIDI_PDI && stack.sp > 0 )
             {
-                c.bc = UCDB_BIDI_R;
-            }
+                // Pop the isolate.  The PDI is at the level of its initiator.
+                ual_bidi_exentry entry = stack.ss[ --stack.sp ];
+                level = entry.level;
 
-            // W4. A single ES between two ENs changes to EN. A single CS
-            // between two AN/ENs changes to AN/EN.
-            if ( c.bc == UCDB_BIDI_EN )
-            {
-                if ( state_w4 != MATCH_EN_XS )
-                {
-                    state_w4 = MATCH_EN;
-                }
-                else
+                // An isolate initiator immediately followed by a PDI does not
+                // introduce any new level run.
+                if ( level != run_level )
                 {
-                    // W7. Change EN to L if the left context is L.
-                    if ( prev_strong == UCDB_BIDI_L )
-                    {
-                        ub->c[ index_w4 ].bc = UCDB_BIDI_L;
-                    }
-                    else
-                    {
-                        ub->c[ index_w4 ].bc = UCDB_BIDI_EN;
-                    }
-                    state_w4 = NONE;
-                    index_w4 = INVALID_INDEX;
+                    unsigned run_eos = boundary_class( run_level, level );
+                    ub->level_runs.push_back( { run_start, run_level, run_sos, run_eos, 0 } );
+
+                    // Continue the isolating run sequence of the initiator.
+                    run_sos = BC_SEQUENCE;
+                    run_start = index;
+                    run_level = level;
+                    run_isolate_count = stack.sp;
+
+                    ual_level_run* prun = &ub->level_runs.at( entry.iprev );
+                    assert( prun->inext == 0 );
+                    assert( prun->eos == BC_SEQUENCE );
+                    prun->inext = (unsigned)ub->level_runs.size();
                 }
             }
-            else if ( c.bc == UCDB_BIDI_AN )
+        }
+
+        // If the level has changed since the last character, then close the
+        // old level run and start a new one.
+        if ( run_level != level )
+        {
+            unsigned run_eos = BC_SEQUENCE;
+            if ( stack.sp <= run_isolate_count )
             {
-                if ( state_w4 != MATCH_AN_CS )
-                {
-                    state_w4 = MATCH_AN;
-                }
-                else
-                {
-                    ub->c[ index_w4 ].bc = UCDB_BIDI_AN;
-                    state_w4 = NONE;
-                    index_w4 = INVALID_INDEX;
-                }
+                // This run ends its isolating run sequence.
+                run_eos = boundary_class( run_level, level );
             }
-            else if ( c.bc == UCDB_BIDI_ES )
-            {
-                // Unmatched separators become ON.  Do this now.
-                c.bc = UCDB_BIDI_ON;
 
-                // Update state.
-                if ( state_w4 == MATCH_EN )
-                {
-                    state_w4 = MATCH_EN_XS;
-                    index_w4 = i;
-                }
-                else
-                {
-                    state_w4 = NONE;
-                }
-            }
-            else if ( c.bc == UCDB_BIDI_CS )
-            {
-                // Unmatched separators become ON.  Do this now.
-                c.bc = UCDB_BIDI_ON;
+            ub->level_runs.push_back( { run_start, run_level, run_sos, run_eos, 0 } );
 
-                // Update state.
-                if ( state_w4 == MATCH_EN )
-                {
-                    state_w4 = MATCH_EN_XS;
-                    index_w4 = i;
-                }
-                else if ( state_w4 == MATCH_AN )
-                {
-                    state_w4 = MATCH_AN_CS;
-                    index_w4 = i;
-                }
-                else
-                {
-                    state_w4 = NONE;
-                }
-            }
-            else
+            run_sos = boundary_class( run_level, level );
+            run_start = index;
+            run_level = level;
+            run_isolate_count = stack.sp;
+        }
+
+        // Push isolate after the initiator has been added to the current run.
+        if ( bc == UCDB_BIDI_LRI || bc == UCDB_BIDI_RLI || bc == UCDB_BIDI_FSI )
+        {
+            bool rl = bc == UCDB_BIDI_RLI;
+            if ( bc == UCDB_BIDI_FSI )
             {
-                state_w4 = NONE;
+                rl = first_strong_level( ub, index + 1, true ) != 0;
             }
 
-            // W5. A sequence of ETs adjacent to EN becomes EN.
-            if ( c.bc == UCDB_BIDI_ET )
+            unsigned next = next_level( level, rl );
+            if ( next > BIDI_MAX_DEPTH || overflow_isolate_count > 0 )
             {
-                if ( prev_w5 == UCDB_BIDI_EN )
-                {
-                    c.bc = UCDB_BIDI_EN;
-                }
-                else
-                {
-                    if ( index_w5 == INVALID_INDEX )
-                    {
-                        index_w5 = i;
-                    }
-
-                    // Postpone further updates until end of ET sequence.
-                    continue;
-                }
+                overflow_isolate_count += 1;
+                continue;
             }
-            else if ( index_w5 != INVALID_INDEX )
-            {
-                unsigned change_to;
-                if ( c.bc == UCDB_BIDI_EN )
-                {
-                    // W6. A sequence of ETs adjacent to EN becomes EN.
-                    change_to = UCDB_BIDI_EN;
 
-                    // W7. Change EN to L if the left context is L.
-                    if ( prev_strong == UCDB_BIDI_L )
-                    {
-                        change_to = UCDB_BIDI_L;
-                    }
-                }
-                else
-                {
-                    // W6. Otherwise, ETs become ON.
-                    change_to = UCDB_BIDI_ON;
-                }
+            assert( stack.sp < BIDI_EXSTACK_LIMIT );
+            stack.ss[ stack.sp++ ] = { level, BIDI_ISOLATE, (unsigned)ub->level_runs.size() };
+            level = next;
+        }
+    }
 
-                while ( index_w5 < i )
-                {
-                    ual_char& et = ub->c[ index_w5++ ];
-                    if ( et.bc == BC_INVALID || et.bc == UCDB_BIDI_BN )
-                    {
-                        continue;
-                    }
+    // Add paragraph separators, which have the paragraph embedding level.
+    if ( index < length )
+    {
+        if ( run_level != paragraph_level )
+        {
+            unsigned run_eos = boundary_class( run_level, paragraph_level );
+            ub->level_runs.push_back( { run_start, run_level, run_sos, run_eos, 0 } );
+            run_sos = run_eos;
+            run_start = index;
+            run_level = paragraph_level;
+        }
+        index = length;
+    }
 
-                    assert( et.bc == UCDB_BIDI_ET );
-                    et.bc = change_to;
-                }
+    // Close final level run.
+    unsigned run_eos = boundary_class( run_level, paragraph_level );
+    ub->level_runs.push_back( { run_start, run_level, run_sos, run_eos, 0 } );
 
-                index_w5 = INVALID_INDEX;
-            }
+    // Close unterminated isolating run sequences.
+    while ( stack.sp > 0 )
+    {
+        ual_bidi_exentry entry = stack.ss[ --stack.sp ];
+        ual_level_run* pprev = &ub->level_runs.at( entry.iprev );
+        unsigned run_eos = boundary_class( pprev->level, paragraph_level );
+        assert( pprev->inext == 0 );
+        assert( pprev->eos == BC_SEQUENCE || pprev->eos == run_eos );
+        pprev->eos = run_eos;
+    }
+
+    // Add a final 'run' to simplify lookup of level runs.
+    ub->level_runs.push_back( { (ual_index)index, paragraph_level, BC_SEQUENCE, BC_SEQUENCE, 0 } );
+
+    // Done.
+    return paragraph_level;
+}
+
+/*
+    Perform rules W1 to W7 on the characters in each level run.
+
+    We make a single pass through the string.  This works because:
+
+        - Level runs in an isolating run sequence which do not terminate the
+          isolating run sequence must end with an isolate initiator.
+        - Level runs in an isolating run sequence which continue the isolating
+          run sequence must begin with a PDI.
+        - Neither isolate initiators nor PDI are removed by rule X9.
+        - Therefore the lookahead in rule W5 must terminate before or at the
+          end of a single level run.
+
+    Both rule W2 and rule W7 require the type of the previous strong character.
+    No weak rule changes the previous strong type - W1 changes the current
+    character to the previous one, while W3 is super-predictable.  Therefore
+    we can keep track of the previous strong type and hand it over to the next
+    level run in the isolating run sequence.
 
-            prev_w5 = c.bc;
+    The rules are implemented by a state machine generated from
+    uax9weak.rules.  Changes to separators and to sequences of ETs depend on
+    later characters, so the machine saves their positions and patches them.
+*/
+
+static void bidi_weak_patch( ual_buffer* ub, size_t lower, size_t upper, unsigned action )
+{
+    unsigned bc = ( action >> UAX9WEAK_SPAN_SHIFT ) & UAX9WEAK_CLASS_MASK;
+    for ( size_t i = lower; i < upper; ++i )
+    {
+        ual_char& et = ub->c[ i ];
+        if ( et.bc == BC_INVALID || et.bc == UCDB_BIDI_BN )
+        {
+            continue;
+        }
+
+        assert( et.bc == UCDB_BIDI_ET );
+        et.bc = bc;
+    }
+}
+
+void bidi_weak( ual_buffer* ub )
+{
+    size_t length = ub->level_runs.size() - 1;
+    for ( size_t i = 0; i < length; ++i )
+    {
+        ual_level_run* prun = &ub->level_runs[ i ];
+        ual_level_run* nrun = &ub->level_runs[ i + 1 ];
+
+        // Start in state for sos.  States are offsets of rows in the table.
+        assert( prun->sos < BC_SEQUENCE );
+        unsigned state = UAX9WEAK_START[ prun->sos ];
+
+        // Saved positions of a separator between numbers, and of the start
+        // of a sequence of ETs.
+        size_t index_sep = prun->start;
+        size_t index_et = prun->start;
+
+        // Update each of the characters in the run.
+        for ( size_t i = prun->start; i < nrun->start; ++i )
+        {
+            ual_char& c = ub->c[ i ];
+            unsigned action = UAX9WEAK[ state + UAX9WEAK_COLUMN[ c.bc ] ];
+            state = action >> UAX9WEAK_STATE_SHIFT;
+            c.bc = action & UAX9WEAK_CLASS_MASK;
 
-            // W6. Otherwise, ET, ES, or CS become ON.
-            assert( c.bc != UCDB_BIDI_ET );
-            if ( c.bc == UCDB_BIDI_ES || c.bc == UCDB_BIDI_CS )
+            // Patch separator.
+            if ( action & UAX9WEAK_PATCH_POINT )
             {
-                c.bc = UCDB_BIDI_ON;
+                ub->c[ index_sep ].bc = ( action >> UAX9WEAK_POINT_SHIFT ) & UAX9WEAK_CLASS_MASK;
             }
 
-            // W7. Change EN to L if the left context is L.
-            if ( c.bc == UCDB_BIDI_EN && prev_strong == UCDB_BIDI_L )
+            // Patch sequence of ETs.
+            if ( action & UAX9WEAK_PATCH_SPAN )
             {
-                c.bc = UCDB_BIDI_L;
+                bidi_weak_patch( ub, index_et, i, action );
             }
 
+            // Save positions.
+            index_sep = ( action & UAX9WEAK_MARK_POINT ) ? i : index_sep;
+            index_et = ( action & UAX9WEAK_MARK_SPAN ) ? i : index_et;
         }
 
         // Deal with case where the level run ends with an ET.
-        if ( index_w5 != INVALID_INDEX )
+        unsigned action = UAX9WEAK_END[ state / UAX9WEAK_COLUMNS ];
+        if ( action & UAX9WEAK_PATCH_SPAN )
         {
-            while ( index_w5 < nrun->start )
-            {
-                ual_char& et = ub->c[ index_w5++ ];
-                if ( et.bc == BC_INVALID || et.bc == UCDB_BIDI_BN )
-                {
-                    continue;
-                }
-
-                assert( et.bc == UCDB_BIDI_ET );
-                et.bc = UCDB_BIDI_ON;
-            }
+            bidi_weak_patch( ub, index_et, nrun->start, action );
         }
 
         // If this run is not the last one in the isolating run sequence, set
@@ -908,7 +946,7 @@ void bidi_weak( ual_buffer* ub )
         if ( prun->inext )
         {
             ual_level_run* pnext = &ub->level_runs.at( prun->inext );
-            pnext->sos = prev_strong;
+            pnext->sos = UAX9WEAK_RESULT[ state / UAX9WEAK_COLUMNS ];
         }
     }
 }
@@ -1002,7 +1040,7 @@ enum ual_bidi_eo_strong
 
 struct ual_bidi_brentry
 {
-    unsigned index;                     // index of opening bracket.
+    ual_index index;                    // index of opening bracket.
     unsigned closing_bracket    : 24;   // codepoint of closing bracket.
     unsigned prev_strong        : 2;    // previous strong /e/, /o/, /e-guess/.
     unsigned prev_contains_e    : 1;    // before bracket contains e.
@@ -1022,37 +1060,31 @@ static ual_bidi_brstack make_brstack( ual_buffer* ub )
     return { ual_stack< ual_bidi_brentry, BIDI_BRSTACK_LIMIT >( ub ), 0 };
 }
 
-static void rewind_o( ual_buffer* ub, size_t irun, unsigned lower, unsigned upper, unsigned o )
+static size_t bidi_level_run_of( ual_buffer* ub, ual_index index )
 {
-    ual_level_run* prun = &ub->level_runs.at( irun );
-    ual_level_run* nrun = &ub->level_runs.at( irun + 1 );
-
-    // Check if bracket has crossed level run boundary.
-    if ( lower < prun->start )
-    {
-        size_t length = ub->level_runs.size() - 1;
-        for ( irun = 0; irun < length; ++irun )
-        {
-            prun = &ub->level_runs[ irun ];
-            nrun = &ub->level_runs[ irun + 1 ];
+    // Level runs are in order of start, followed by the sentinel.
+    auto lrun = std::upper_bound
+    (
+        ub->level_runs.begin(), ub->level_runs.end() - 1, index,
+        []( ual_index index, const ual_level_run& lrun ) { return index < lrun.start; }
+    );
+    return lrun - ub->level_runs.begin() - 1;
+}
 
-            if ( prun->start <= lower && nrun->start < upper )
-            {
-                break;
-            }
-        }
+static void rewind_o( ual_buffer* ub, ual_index lower, ual_index upper, unsigned o )
+{
+    stats_add( ub->stats.rewinds, 1 );
 
-        if ( irun >= length )
-        {
-            assert( ! "invalid rewind index" );
-            return;
-        }
-    }
+    // Opening bracket may be in any level run of the isolating run sequence.
+    size_t irun = bidi_level_run_of( ub, lower );
+    ual_level_run* prun = &ub->level_runs.at( irun );
+    ual_level_run* nrun = &ub->level_runs.at( irun + 1 );
+    assert( prun->start <= lower && lower < nrun->start );
 
     // I *think* it is sufficient to resolve all BRACKET in the range to /o/.
     // All brackets that don't depend on the incorrect guess should already
     // have been resolved.  But it requires more testing to confirm.
-    for ( unsigned index = lower; index < upper; ++index )
+    for ( ual_index index = lower; index < upper; ++index )
     {
         while ( index >= nrun->start )
         {
@@ -1095,7 +1127,7 @@ static void bidi_isolating_brackets( ual_buffer* ub, ual_bidi_brstack* stack, si
     while ( true )
     {
         // Process characters in level run.
-        for ( unsigned index = prun->start; index < nrun->start; ++index )
+        for ( ual_index index = prun->start; index < nrun->start; ++index )
         {
             ual_char& c = ub->c[ index ];
             switch ( c.bc )
@@ -1145,6 +1177,7 @@ static void bidi_isolating_brackets( ual_buffer* ub, ual_bidi_brstack* stack, si
                     }
 
                     // Push open bracket.
+                    stats_add( ub->stats.brackets_pushed, 1 );
                     stack->ss[ stack->sp++ ] =
                     {
                         index,
@@ -1214,7 +1247,7 @@ static void bidi_isolating_brackets( ual_buffer* ub, ual_bidi_brstack* stack, si
                         else if ( entry->prev_strong == BIDI_O )
                         {
                             // Brackets dependent on this context become /o/.
-                            rewind_o( ub, irun, entry->index, index, o );
+                            rewind_o( ub, entry->index, index, o );
                         }
                     }
                 }
@@ -1277,7 +1310,7 @@ static void bidi_isolating_brackets( ual_buffer* ub, ual_bidi_brstack* stack, si
                     // Guess was wrong.  If any inner pairs depend on it, rewind.
                     if ( entry->rewind_point )
                     {
-                        rewind_o( ub, irun, entry->index, index, o );
+                        rewind_o( ub, entry->index, index, o );
                     }
 
                     //printf( "BIDI_BRACKET %u %u O\n", entry->index, index );
@@ -1323,7 +1356,7 @@ static void bidi_isolating_brackets( ual_buffer* ub, ual_bidi_brstack* stack, si
             else if ( entry->prev_strong == BIDI_O )
             {
                 // Brackets dependent on this context become /o/.
-                rewind_o( ub, irun, entry->index, nrun->start, o );
+                rewind_o( ub, entry->index, nrun->start, o );
             }
         }
     }
@@ -1387,12 +1420,12 @@ enum ual_bidi_neutral_kind
     NEUTRAL_SPAN,
 };
 
-static void bidi_resolve_neutrals( ual_buffer* ub, size_t irun, unsigned lower, unsigned upper, unsigned bc )
+static void bidi_resolve_neutrals( ual_buffer* ub, size_t irun, ual_index lower, ual_index upper, unsigned bc )
 {
     ual_level_run* prun = &ub->level_runs.at( irun );
     ual_level_run* nrun = &ub->level_runs.at( irun + 1 );
 
-    for ( unsigned index = lower; index < upper; ++index )
+    for ( ual_index index = lower; index < upper; ++index )
     {
         while ( index >= nrun->start )
         {
@@ -1427,14 +1460,14 @@ static void bidi_isolating_neutral( ual_buffer* ub, size_t irun )
     // No run of neutrals yet.
     ual_bidi_neutral_kind neutrals = NEUTRAL_NONE;
     size_t lirun = irun;
-    unsigned lower = 0;
+    ual_index lower = 0;
     unsigned prev_w1 = prun->sos;
 
     // Go through every level run in isolating run sequence.
     while ( true )
     {
         // Process characters in level run.
-        for ( unsigned index = prun->start; index < nrun->start; ++index )
+        for ( ual_index index = prun->start; index < nrun->start; ++index )
         {
             ual_char& c = ub->c[ index ];
             if ( c.bc == BC_INVALID )
@@ -1531,8 +1564,9 @@ static void bidi_isolating_neutral( ual_buffer* ub, size_t irun )
         }
 
         assert( prun->eos == BC_SEQUENCE );
-        prun = &ub->level_runs.at( inext );
-        nrun = &ub->level_runs.at( inext + 1 );
+        irun = inext;
+        prun = &ub->level_runs.at( irun );
+        nrun = &ub->level_runs.at( irun + 1 );
     }
 
     assert( prun->eos == UCDB_BIDI_L || prun->eos == UCDB_BIDI_R );
@@ -1562,6 +1596,76 @@ void bidi_neutral( ual_buffer* ub )
     }
 }
 
+/*
+    In a paragraph containing only strong characters and whitespace, the weak
+    rules only change AL to R, and there are no brackets.  Resolve neutrals
+    using rules N1 and N2 directly.  There is a single level run.
+*/
+
+static void bidi_strong_neutrals( ual_buffer* ub, size_t lower, size_t upper, unsigned bc )
+{
+    for ( size_t i = lower; i < upper; ++i )
+    {
+        ual_char& k = ub->c[ i ];
+        if ( k.bc != UCDB_BIDI_BN && k.bc != BC_INVALID )
+        {
+            k.bc = bc;
+        }
+    }
+}
+
+void bidi_strong( ual_buffer* ub )
+{
+    assert( ub->level_runs.size() == 2 );
+    const ual_level_run* prun = &ub->level_runs[ 0 ];
+    unsigned e = prun->level & 1;
+    assert( prun->sos == e && prun->eos == e );
+
+    unsigned prev_strong = e;
+    size_t index_neutral = INVALID_INDEX;
+
+    size_t length = ub->c.size();
+    for ( size_t index = 0; index < length; ++index )
+    {
+        ual_char& c = ub->c[ index ];
+        switch ( c.bc )
+        {
+        case UCDB_BIDI_AL:
+            c.bc = UCDB_BIDI_R;
+            // fall through
+
+        case UCDB_BIDI_L:
+        case UCDB_BIDI_R:
+            // Neutrals between strong characters of the same direction take
+            // that direction, otherwise the embedding direction.
+            if ( index_neutral != INVALID_INDEX )
+            {
+                unsigned bc = prev_strong == c.bc ? c.bc : e;
+                bidi_strong_neutrals( ub, index_neutral, index, bc );
+                index_neutral = INVALID_INDEX;
+            }
+            prev_strong = c.bc;
+            break;
+
+        case UCDB_BIDI_WS:
+        case UCDB_BIDI_S:
+        case UCDB_BIDI_B:
+            // Start of sequence of neutrals.
+            if ( index_neutral == INVALID_INDEX )
+            {
+                index_neutral = index;
+            }
+            break;
+        }
+    }
+
+    // Neutrals before eos, which is the embedding direction.
+    if ( index_neutral != INVALID_INDEX )
+    {
+        bidi_strong_neutrals( ub, index_neutral, length, e );
+    }
+}
+
 /*
     Apply rule L1, reinstating all runs of WS or isloate formatting characters
     preceding S, B, or the end of the paragraph as WS.  S and B are also
@@ -1668,6 +1772,10 @@ void bidi_initial( ual_buffer* ub, unsigned override_paragraph_level )
     {
         complexity = BIDI_SOLITARY;
     }
+    if ( complexity == BIDI_ALL_RIGHT && override_paragraph_level != UAL_FROM_TEXT && ( override_paragraph_level & 1 ) == 0 )
+    {
+        complexity = BIDI_SOLITARY;
+    }
 
     // Perform level run anlysis.
     size_t index = 0;
@@ -1678,186 +1786,691 @@ void bidi_initial( ual_buffer* ub, unsigned override_paragraph_level )
         // Entire string is left to right.  No further analysis required.
         index = ub->c.size();
         ub->level_runs.push_back( { 0, 0, UCDB_BIDI_L, UCDB_BIDI_L, 0 } );
-        ub->level_runs.push_back( { (unsigned)index, paragraph_level, BC_SEQUENCE, BC_SEQUENCE, 0 } );
+        ub->level_runs.push_back( { (ual_index)index, paragraph_level, BC_SEQUENCE, BC_SEQUENCE, 0 } );
         break;
 
+    case BIDI_ALL_RIGHT:
+        // Entire string is right to left.  No further analysis required.
+        index = ub->c.size();
+        paragraph_level = override_paragraph_level != UAL_FROM_TEXT ? override_paragraph_level : 1;
+        ub->level_runs.push_back( { 0, paragraph_level, UCDB_BIDI_R, UCDB_BIDI_R, 0 } );
+        ub->level_runs.push_back( { (ual_index)index, paragraph_level, BC_SEQUENCE, BC_SEQUENCE, 0 } );
+        break;
+
+    case BIDI_STRONG:
     case BIDI_SOLITARY:
         // There is only one level run at rule X10.
         paragraph_level = bidi_solitary( ub, override_paragraph_level );
         break;
 
+    case BIDI_ISOLATES:
+        // Isolates can be processed without the full status stack.
+        paragraph_level = bidi_isolates( ub, override_paragraph_level );
+        break;
+
     case BIDI_EXPLICIT:
         // We require full processing of embeddings/overrides/isolates.
         paragraph_level = bidi_explicit( ub, override_paragraph_level );
         break;
     }
 
+    if ( workload_active() )
+    {
+        workload_complexity( complexity );
+    }
+
     // Set up analysis state.
-    ub->bidi_analysis.ilrun = 0;
-    ub->bidi_analysis.index = index;
+    ub->bidi_analysis.irun = INVALID_INDEX;
+    ub->bidi_analysis.isequence = INVALID_INDEX;
+    ub->bidi_analysis.paragraph_level = paragraph_level;
+    ub->bidi_analysis.complexity = complexity;
+    ub->bidi_analysis.valid = false;
+}
+
+/*
+    Build bidi runs from resolved classes, in a single pass at the end of bidi
+    analysis.  Within a level run, the level of a character depends only on
+    its resolved class, so a small table for each level run gives the level.
+    BN and the low half of a surrogate pair do not start a new bidi run.
+
+    Characters in odd-level runs which have a mirrored glyph are collected in
+    the same pass.  All characters with a mirrored glyph are ON.
+
+    A paragraph which is entirely left-to-right needs no bidi runs at all.
+*/
+
+const uint8_t LEVEL_CARRY = 0xFF;
+
+static void bidi_mirror( ual_buffer* ub, size_t index )
+{
+    const ual_char& c = ub->c[ index ];
+    if ( UCDB_TABLE[ c.ix ].bclass == UCDB_BIDI_ON )
+    {
+        char32_t cp = ual_codepoint( ub, index );
+        char32_t mirror = ucdb_mirrored_glyph( cp );
+        if ( mirror != cp )
+        {
+            ub->bidi_mirrors.push_back( { index, mirror } );
+        }
+    }
+}
+
+static void bidi_runs( ual_buffer* ub )
+{
+    ub->bidi_runs.clear();
+    ub->bidi_mirrors.clear();
+
+    ual_bidi_complexity complexity = ub->bidi_analysis.complexity;
+    if ( complexity == BIDI_ALL_LEFT )
+    {
+        return;
+    }
+
+    bool mirrors = ( ub->options & UAL_OPTION_BIDI_MIRRORS ) != 0;
+    unsigned paragraph_level = ub->bidi_analysis.paragraph_level;
+    ual_index length = ub->c.size();
+    const ual_char* c = ub->c.data();
+
+    if ( complexity == BIDI_ALL_RIGHT )
+    {
+        // Classes are unresolved, but there is a single odd-level run.
+        if ( mirrors )
+        {
+            for ( size_t index = 0; index < length; ++index )
+            {
+                if ( c[ index ].ix != IX_INVALID )
+                {
+                    bidi_mirror( ub, index );
+                }
+            }
+        }
+
+        ub->bidi_runs.push_back( { 0, ub->level_runs[ 0 ].level, 0 } );
+        ub->bidi_runs.push_back( { length, paragraph_level, (ual_index)ub->bidi_mirrors.size() } );
+        return;
+    }
+
+    ual_index run_lower = 0;
+    unsigned run_level = LEVEL_CARRY;
+    ual_index run_mirror = 0;
+
+    size_t lrun_length = ub->level_runs.size() - 1;
+    for ( size_t ilrun = 0; ilrun < lrun_length; ++ilrun )
+    {
+        const ual_level_run* prun = &ub->level_runs[ ilrun ];
+        const ual_level_run* nrun = &ub->level_runs[ ilrun + 1 ];
+
+        // Build table of levels for this level run.
+        unsigned rlevel = prun->level;
+        unsigned odd = rlevel & 1;
+        uint8_t table[ 32 ];
+        memset( table, LEVEL_CARRY, sizeof( table ) );
+        table[ UCDB_BIDI_L ] = rlevel + odd;
+        table[ UCDB_BIDI_R ] = rlevel + ( odd ^ 1 );
+        table[ UCDB_BIDI_EN ] = rlevel + 2 - odd;
+        table[ UCDB_BIDI_AN ] = rlevel + 2 - odd;
+        table[ UCDB_BIDI_WS ] = paragraph_level;
+
+        for ( ual_index index = prun->start; index < nrun->start; ++index )
+        {
+            unsigned level = table[ c[ index ].bc ];
+            if ( level == LEVEL_CARRY )
+            {
+                continue;
+            }
+
+            if ( level != run_level )
+            {
+                // Start new run, unless this is the first real character.
+                if ( run_level != LEVEL_CARRY )
+                {
+                    ub->bidi_runs.push_back( { run_lower, run_level, run_mirror } );
+                    run_lower = index;
+                    run_mirror = ub->bidi_mirrors.size();
+                }
+                run_level = level;
+            }
+
+            if ( mirrors && ( level & 1 ) != 0 )
+            {
+                bidi_mirror( ub, index );
+            }
+        }
+    }
+
+    if ( length )
+    {
+        run_level = run_level != LEVEL_CARRY ? run_level : paragraph_level;
+        ub->bidi_runs.push_back( { run_lower, run_level, run_mirror } );
+    }
+    ub->bidi_runs.push_back( { length, paragraph_level, (ual_index)ub->bidi_mirrors.size() } );
+}
+
+/*
+    Cached bidi results are the level runs, bidi runs, and mirrors, with
+    positions stored as varint differences.  Resolved classes are not cached.
+*/
+
+static uint64_t bidi_cache_kind( ual_buffer* ub, unsigned override_paragraph_level )
+{
+    uint64_t mirrors = ( ub->options & UAL_OPTION_BIDI_MIRRORS ) != 0;
+    return CACHE_BIDI | mirrors << 2 | (uint64_t)( override_paragraph_level + 1 ) << 3;
+}
+
+static bool bidi_cache_restore( ual_buffer* ub, uint64_t kind )
+{
+    const uint8_t* p = cache_section( ub, kind );
+    if ( ! p )
+    {
+        return false;
+    }
+
+    ual_bidi_complexity complexity = (ual_bidi_complexity)read_varint( &p );
+    unsigned paragraph_level = read_varint( &p );
+
+    size_t count = read_varint( &p );
+    ual_index start = 0;
+    ub->level_runs.clear();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        start += read_varint( &p );
+        unsigned level = read_varint( &p );
+        unsigned sos_eos = read_varint( &p );
+        unsigned inext = read_varint( &p );
+        ub->level_runs.push_back( { start, level, sos_eos & 3, sos_eos >> 2, inext } );
+    }
+
+    count = read_varint( &p );
+    ual_index lower = 0;
+    ub->bidi_runs.clear();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        lower += read_varint( &p );
+        unsigned level = read_varint( &p );
+        ual_index imirror = read_varint( &p );
+        ub->bidi_runs.push_back( { lower, level, imirror } );
+    }
+
+    count = read_varint( &p );
+    size_t index = 0;
+    ub->bidi_mirrors.clear();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        index += read_varint( &p );
+        uint32_t mirror = read_varint( &p );
+        ub->bidi_mirrors.push_back( { index, mirror } );
+    }
+
+    if ( workload_active() )
+    {
+        workload_complexity( complexity );
+    }
+
+    // Break flags are invalidated as if classes had been resolved.
+    ub->bc_usage = BC_BIDI_CLASS;
+    ub->bidi_analysis.irun = INVALID_INDEX;
+    ub->bidi_analysis.isequence = INVALID_INDEX;
     ub->bidi_analysis.paragraph_level = paragraph_level;
     ub->bidi_analysis.complexity = complexity;
+    ub->bidi_analysis.valid = true;
+    return true;
+}
+
+static void bidi_cache_store( ual_buffer* ub, uint64_t kind )
+{
+    std::vector< uint8_t >* data = &ub->cache_data;
+    data->clear();
+    push_varint( data, ub->bidi_analysis.complexity );
+    push_varint( data, ub->bidi_analysis.paragraph_level );
+
+    push_varint( data, ub->level_runs.size() );
+    ual_index start = 0;
+    for ( const ual_level_run& run : ub->level_runs )
+    {
+        push_varint( data, run.start - start );
+        push_varint( data, run.level );
+        push_varint( data, run.sos | run.eos << 2 );
+        push_varint( data, run.inext );
+        start = run.start;
+    }
+
+    push_varint( data, ub->bidi_runs.size() );
+    ual_index lower = 0;
+    for ( const ual_bidi_entry& run : ub->bidi_runs )
+    {
+        push_varint( data, run.lower - lower );
+        push_varint( data, run.level );
+        push_varint( data, run.imirror );
+        lower = run.lower;
+    }
+
+    push_varint( data, ub->bidi_mirrors.size() );
+    size_t index = 0;
+    for ( const ual_bidi_mirror& mirror : ub->bidi_mirrors )
+    {
+        push_varint( data, mirror.index - index );
+        push_varint( data, mirror.mirror );
+        index = mirror.index;
+    }
+
+    cache_insert( ub, kind, *data );
 }
 
 UAL_API unsigned ual_analyze_bidi( ual_buffer* ub, unsigned override_paragraph_level )
 {
-    //printf( "INITIAL\n" );
+    UAL_PROBE1( bidi_begin, ub->c.size() );
+    stats_add( ub->stats.bidi_paragraphs, 1 );
+    stats_add( ub->stats.bidi_units, ub->c.size() );
+    uint64_t ticks = stats_ticks();
+
+    // Restore results for the same text and override level from the cache.
+    uint64_t cache_kind = 0;
+    if ( ub->cache )
+    {
+        cache_kind = bidi_cache_kind( ub, override_paragraph_level );
+        if ( bidi_cache_restore( ub, cache_kind ) )
+        {
+            stats_lap( ub->stats.runs_ticks, ticks );
+            UAL_PROBE3( bidi_end, ub->c.size(), (unsigned)ub->bidi_analysis.complexity, ub->bidi_analysis.paragraph_level );
+            return ub->bidi_analysis.paragraph_level;
+        }
+    }
+
     bidi_initial( ub, override_paragraph_level );
-    //debug_print_bidi( ub );
+    ticks = stats_lap( ub->stats.explicit_ticks, ticks );
+    stats_add( ub->stats.level_runs, ub->level_runs.size() - 1 );
 
-    if ( ub->bidi_analysis.complexity != BIDI_ALL_LEFT )
+    switch ( ub->bidi_analysis.complexity )
     {
-        //printf( "WEAK\n" );
+    case BIDI_ALL_LEFT:
+    case BIDI_ALL_RIGHT:
+        // All characters are at the paragraph level.
+        break;
+
+    case BIDI_STRONG:
+        bidi_strong( ub );
+        ticks = stats_lap( ub->stats.neutral_ticks, ticks );
+
+        bidi_whitespace( ub );
+        ticks = stats_lap( ub->stats.whitespace_ticks, ticks );
+        break;
+
+    case BIDI_SOLITARY:
+    case BIDI_ISOLATES:
+    case BIDI_EXPLICIT:
         bidi_weak( ub );
-        //debug_print_bidi( ub );
+        ticks = stats_lap( ub->stats.weak_ticks, ticks );
 
-        //printf( "BRACKETS\n" );
         bidi_brackets( ub );
-        //debug_print_bidi( ub );
+        ticks = stats_lap( ub->stats.brackets_ticks, ticks );
 
-        //printf( "NEUTRAL\n" );
         bidi_neutral( ub );
-        //debug_print_bidi( ub );
+        ticks = stats_lap( ub->stats.neutral_ticks, ticks );
 
-        //printf( "WHITESPACE\n" );
         bidi_whitespace( ub );
-        //debug_print_bidi( ub );
+        ticks = stats_lap( ub->stats.whitespace_ticks, ticks );
+        break;
+    }
+
+    bidi_runs( ub );
+    stats_lap( ub->stats.runs_ticks, ticks );
+    ub->bidi_analysis.valid = true;
+
+    if ( ub->cache )
+    {
+        bidi_cache_store( ub, cache_kind );
     }
 
+    UAL_PROBE3( bidi_end, ub->c.size(), (unsigned)ub->bidi_analysis.complexity, ub->bidi_analysis.paragraph_level );
+
     return ub->bidi_analysis.paragraph_level;
 }
 
 /*
-    Iterator-style interface for constructing bidi runs from resolved classes.
+    Iterator-style interface for returning bidi runs.  For a paragraph which
+    is entirely left-to-right, the single level run is the only bidi run.
 */
 
 UAL_API void ual_bidi_runs_begin( ual_buffer* ub )
 {
-    assert( ub->bc_usage == BC_BIDI_CLASS );
-    assert( ub->level_runs.back().start == ub->c.size() );
+    assert( ub->bidi_analysis.valid );
+    ub->bidi_analysis.irun = 0;
+}
+
+UAL_API bool ual_bidi_runs_next( ual_buffer* ub, ual_bidi_run* out_run )
+{
+    assert( ub->bidi_analysis.valid );
 
-    //debug_print_bidi( ub );
+    size_t irun = ub->bidi_analysis.irun;
+    assert( irun != INVALID_INDEX );
 
-    ub->bidi_analysis.ilrun = 0;
-    ub->bidi_analysis.index = 0;
+    size_t length = ub->c.size();
+    if ( ub->bidi_analysis.complexity == BIDI_ALL_LEFT )
+    {
+        if ( irun == 0 && length )
+        {
+            ub->bidi_analysis.irun = 1;
+            out_run->lower = 0;
+            out_run->upper = length;
+            out_run->level = ub->level_runs[ 0 ].level;
+            return true;
+        }
+    }
+    else if ( irun + 1 < ub->bidi_runs.size() )
+    {
+        ub->bidi_analysis.irun = irun + 1;
+        const ual_bidi_entry* prun = &ub->bidi_runs[ irun ];
+        out_run->lower = prun[ 0 ].lower;
+        out_run->upper = prun[ 1 ].lower;
+        out_run->level = prun[ 0 ].level;
+        return true;
+    }
+
+    // Reached the end.
+    out_run->lower = length;
+    out_run->upper = length;
+    out_run->level = ub->bidi_analysis.paragraph_level;
+    return false;
 }
 
-UAL_API bool ual_bidi_runs_next( ual_buffer* ub, ual_bidi_run* out_run )
+UAL_API const ual_bidi_mirror* ual_bidi_run_mirrors( ual_buffer* ub, size_t* out_count )
 {
-    assert( ub->bc_usage == BC_BIDI_CLASS );
+    size_t irun = ub->bidi_analysis.irun;
+    if ( irun == 0 || irun == INVALID_INDEX || irun >= ub->bidi_runs.size() )
+    {
+        *out_count = 0;
+        return nullptr;
+    }
 
-    size_t ilrun = ub->bidi_analysis.ilrun;
-    size_t index = ub->bidi_analysis.index;
-    assert( ilrun != INVALID_INDEX );
-    assert( index != INVALID_INDEX );
+    const ual_bidi_entry* prun = &ub->bidi_runs[ irun - 1 ];
+    *out_count = prun[ 1 ].imirror - prun[ 0 ].imirror;
+    return ub->bidi_mirrors.data() + prun[ 0 ].imirror;
+}
 
-    // Run starts at index.
-    out_run->lower = index;
-    unsigned level = ub->bidi_analysis.paragraph_level;
-    bool linit = true;
+UAL_API void ual_bidi_runs_end( ual_buffer* ub )
+{
+    ub->bidi_analysis.irun = INVALID_INDEX;
+}
 
-    while ( ilrun < ub->level_runs.size() - 1 )
+/*
+    Iterator-style interface for returning isolating run sequences.  Level
+    runs which continue a sequence have sos BC_SEQUENCE, so each sequence is
+    returned in order of its first level run.
+*/
+
+UAL_API void ual_bidi_sequences_begin( ual_buffer* ub )
+{
+    assert( ub->bidi_analysis.valid );
+    ub->bidi_analysis.isequence = 0;
+}
+
+UAL_API bool ual_bidi_sequences_next( ual_buffer* ub, ual_bidi_sequence* out_sequence )
+{
+    assert( ub->bidi_analysis.valid );
+
+    size_t isequence = ub->bidi_analysis.isequence;
+    assert( isequence != INVALID_INDEX );
+
+    // Find next level run which starts an isolating run sequence.
+    size_t length = ub->level_runs.size() - 1;
+    while ( isequence < length && ub->level_runs[ isequence ].sos == BC_SEQUENCE )
     {
-        ual_level_run* prun = &ub->level_runs[ ilrun ];
-        ual_level_run* nrun = &ub->level_runs[ ilrun + 1 ];
+        isequence += 1;
+    }
 
-        assert( prun->start < nrun->start );
-        assert( nrun->start <= ub->c.size() );
-        assert( prun->start <= index );
-        assert( index < nrun->start );
+    ub->bidi_ranges.clear();
+    if ( isequence >= length || ub->c.empty() )
+    {
+        ub->bidi_analysis.isequence = length;
+        out_sequence->level = ub->bidi_analysis.paragraph_level;
+        out_sequence->sos = out_sequence->level & 1;
+        out_sequence->eos = out_sequence->level & 1;
+        out_sequence->range_count = 0;
+        out_sequence->ranges = nullptr;
+        return false;
+    }
+
+    ub->bidi_analysis.isequence = isequence + 1;
 
-        if ( ub->bidi_analysis.complexity == BIDI_ALL_LEFT )
+    // Follow links through the sequence.
+    const ual_level_run* prun = &ub->level_runs[ isequence ];
+    out_sequence->level = prun->level;
+    out_sequence->sos = prun->sos == UCDB_BIDI_L ? 0 : 1;
+    while ( true )
+    {
+        ub->bidi_ranges.push_back( { prun[ 0 ].start, prun[ 1 ].start } );
+        if ( ! prun->inext )
         {
-            // Move over level run.
-            ilrun += 1;
-            index = nrun->start;
+            break;
+        }
+        prun = &ub->level_runs[ prun->inext ];
+    }
 
-            // Save state.
-            ub->bidi_analysis.index = index;
-            ub->bidi_analysis.ilrun = ilrun;
+    assert( prun->eos != BC_SEQUENCE );
+    out_sequence->eos = prun->eos == UCDB_BIDI_L ? 0 : 1;
+    out_sequence->range_count = ub->bidi_ranges.size();
+    out_sequence->ranges = ub->bidi_ranges.data();
+    return true;
+}
 
-            // Return run.
-            out_run->upper = index;
-            out_run->level = prun->level;
-            return true;
+UAL_API void ual_bidi_sequences_end( ual_buffer* ub )
+{
+    ub->bidi_analysis.isequence = INVALID_INDEX;
+}
+
+/*
+    Write the level of each character directly from bidi runs.
+*/
+
+static void bidi_levels( ual_buffer* ub, size_t lower, size_t upper, uint8_t* out_levels )
+{
+    assert( ub->bidi_analysis.valid );
+    assert( lower <= upper && upper <= ub->c.size() );
+
+    if ( ub->bidi_analysis.complexity == BIDI_ALL_LEFT )
+    {
+        memset( out_levels, ub->level_runs[ 0 ].level, upper - lower );
+        return;
+    }
+
+    // Find bidi run containing lower.
+    auto prun = std::upper_bound
+    (
+        ub->bidi_runs.begin(), ub->bidi_runs.end() - 1, lower,
+        []( size_t index, const ual_bidi_entry& run ) { return index < run.lower; }
+    ) - 1;
+
+    size_t index = lower;
+    while ( index < upper )
+    {
+        size_t run_upper = std::min< size_t >( prun[ 1 ].lower, upper );
+        memset( out_levels + ( index - lower ), prun[ 0 ].level, run_upper - index );
+        index = run_upper;
+        ++prun;
+    }
+}
+
+UAL_API void ual_bidi_levels( ual_buffer* ub, uint8_t* out_levels )
+{
+    bidi_levels( ub, 0, ub->c.size(), out_levels );
+}
+
+UAL_API void ual_bidi_line_levels( ual_buffer* ub, size_t lower, size_t upper, uint8_t* out_levels )
+{
+    bidi_levels( ub, lower, upper, out_levels );
+
+    // Apply rule L1 to whitespace and isolate formatting characters at the
+    // end of the line, using their original class.
+    uint8_t paragraph_level = ub->bidi_analysis.paragraph_level;
+    size_t index = upper;
+    while ( index-- > lower )
+    {
+        const ual_char& c = ub->c[ index ];
+        if ( c.ix == IX_INVALID )
+        {
+            continue;
         }
 
-        unsigned rlevel = prun->level;
-        while ( index < nrun->start )
+        unsigned bc = UCDB_TABLE[ c.ix ].bclass;
+        if ( bc == UCDB_BIDI_BN || bc == UCDB_BIDI_RLE || bc == UCDB_BIDI_LRE
+            || bc == UCDB_BIDI_RLO || bc == UCDB_BIDI_LRO || bc == UCDB_BIDI_PDF )
         {
-            unsigned bc = ub->c[ index ].bc;
+            // Ignore characters removed by rule X9.
+            continue;
+        }
 
-            unsigned clevel;
-            switch ( bc )
-            {
-            case UCDB_BIDI_BN:
-            case BC_INVALID:
-                ++index;
-                continue;
+        if ( bc != UCDB_BIDI_WS && bc != UCDB_BIDI_FSI && bc != UCDB_BIDI_LRI
+            && bc != UCDB_BIDI_RLI && bc != UCDB_BIDI_PDI )
+        {
+            break;
+        }
 
-            case UCDB_BIDI_L:
-                clevel = rlevel + ( ( rlevel & 1 ) == 0 ? 0 : 1 );
-                break;
+        out_levels[ index - lower ] = paragraph_level;
+    }
+}
 
-            case UCDB_BIDI_R:
-                clevel = rlevel + ( ( rlevel & 1 ) == 0 ? 1 : 0 );
-                break;
+/*
+    Batch analysis.  Most short strings are a single paragraph which is either
+    entirely left-to-right or entirely right-to-left.  One scan over the text
+    finds these without building the char buffer.  Other strings are analyzed
+    in the buffer, which is reused across strings, and runs are copied directly
+    from the bidi run entries.
+*/
 
-            case UCDB_BIDI_EN:
-            case UCDB_BIDI_AN:
-                clevel = rlevel + ( ( rlevel & 1 ) == 0 ? 2 : 1 );
-                break;
+static bool bidi_batch_uniform( const char16_t* text, size_t size, unsigned override_paragraph_level, unsigned* out_level )
+{
+    uint32_t classes = 0;
+    unsigned prev = UCDB_LBREAK_XX;
+    size_t index = 0;
+    while ( index < size )
+    {
+        char32_t uc = ual_decode( text, size, &index );
+        const ucdb_entry& entry = UCDB_TABLE[ ucdb_lookup( uc ) ];
 
-            case UCDB_BIDI_WS:
-                clevel = ub->bidi_analysis.paragraph_level;
-                break;
+        // Strings with more than one paragraph use the buffer.
+        unsigned curr = ual::detail::paragraph_lbreak( entry );
+        if ( ual::detail::paragraph_break( prev, curr ) )
+        {
+            return false;
+        }
+        prev = curr;
 
-            default:
-                //fprintf( stderr, "invalid surviving class: %s\n", bidi_cs( bc ) );
-                assert( ! "invalid surviving bidi class" );
+        // Stop as soon as the string needs the full algorithm.
+        classes |= bidi_set( entry.bclass );
+        if ( ( classes & BIDI_SET_EXPLICIT ) || ( ( classes & BIDI_SET_RIGHT ) && ( classes & BIDI_SET_LEFT ) ) )
+        {
+            return false;
+        }
+    }
+
+    if ( ! ( classes & BIDI_SET_RIGHT ) )
+    {
+        // Left-to-right, unless the paragraph level is overridden.
+        if ( override_paragraph_level != UAL_FROM_TEXT && override_paragraph_level != 0 )
+        {
+            return false;
+        }
+        *out_level = 0;
+        return true;
+    }
+    else
+    {
+        // Right-to-left, unless the paragraph level is overridden to be even.
+        if ( override_paragraph_level == UAL_FROM_TEXT )
+        {
+            *out_level = 1;
+            return true;
+        }
+        if ( ( override_paragraph_level & 1 ) == 0 )
+        {
+            return false;
+        }
+        *out_level = override_paragraph_level;
+        return true;
+    }
+}
+
+UAL_API size_t ual_analyze_bidi_batch( ual_buffer* ub, const ual_bidi_batch_string* strings, size_t count, unsigned override_paragraph_level, ual_bidi_batch_result* out_results, ual_bidi_run* out_runs, size_t runs_size )
+{
+    size_t run_count = 0;
+    size_t istring = 0;
+    for ( ; istring < count; ++istring )
+    {
+        const char16_t* text = strings[ istring ].text;
+        size_t size = strings[ istring ].size;
+
+        ual_bidi_batch_result result = { 0, run_count, 0 };
+        if ( override_paragraph_level != UAL_FROM_TEXT )
+        {
+            result.paragraph_level = override_paragraph_level;
+        }
+
+        // Check for a string which is a single run.  While workload statistics
+        // are collected, every string is analyzed in the buffer.
+        unsigned level = 0;
+        if ( size && ! workload_active() && bidi_batch_uniform( text, size, override_paragraph_level, &level ) )
+        {
+            if ( run_count >= runs_size )
+            {
                 break;
             }
 
-            if ( linit )
+            out_runs[ run_count++ ] = { 0, size, level };
+            result.paragraph_level = level;
+            result.run_count = 1;
+            out_results[ istring ] = result;
+            continue;
+        }
+
+        // Analyze each paragraph in the buffer.
+        size_t lower = 0;
+        bool full = false;
+        while ( lower < size )
+        {
+            size_t length = ual_analyze_paragraph( ub, text + lower, size - lower );
+            unsigned paragraph_level = ual_analyze_bidi( ub, override_paragraph_level );
+            if ( lower == 0 )
             {
-                level = clevel;
-                linit = false;
+                result.paragraph_level = paragraph_level;
             }
 
-            if ( clevel != level )
+            if ( ub->bidi_analysis.complexity == BIDI_ALL_LEFT )
             {
-                break;
+                if ( run_count >= runs_size )
+                {
+                    full = true;
+                    break;
+                }
+                out_runs[ run_count++ ] = { lower, lower + length, ub->level_runs[ 0 ].level };
             }
+            else
+            {
+                size_t bidi_run_count = ub->bidi_runs.size() - 1;
+                if ( run_count + bidi_run_count > runs_size )
+                {
+                    full = true;
+                    break;
+                }
 
-            ++index;
-        }
+                const ual_bidi_entry* prun = ub->bidi_runs.data();
+                for ( size_t irun = 0; irun < bidi_run_count; ++irun )
+                {
+                    out_runs[ run_count++ ] = { lower + prun[ irun ].lower, lower + prun[ irun + 1 ].lower, prun[ irun ].level };
+                }
+            }
 
-        assert( index <= nrun->start );
-        assert( out_run->lower < index );
+            lower += length;
+        }
 
-        if ( index < nrun->start )
+        if ( full )
         {
             break;
         }
 
-        ilrun += 1;
+        result.run_count = run_count - result.run_index;
+        out_results[ istring ] = result;
     }
 
-    // Save state.
-    ub->bidi_analysis.ilrun = ilrun;
-    ub->bidi_analysis.index = index;
-
-    // Return resulting run.
-    out_run->upper = index;
-    out_run->level = level;
-
-    // Check if we've reached the end.
-    return out_run->lower < ub->c.size();
+    ual_analyze_paragraph( ub, nullptr, 0 );
+    return istring;
 }
-
-UAL_API void ual_bidi_runs_end( ual_buffer* ub )
-{
-    ub->bidi_analysis.ilrun = INVALID_INDEX;
-    ub->bidi_analysis.index = INVALID_INDEX;
-}
-
@@ -10,29 +10,307 @@
 
 #include "ualyze.h"
 #include <assert.h>
+#include <algorithm>
 #include "ual_buffer.h"
+#include "ualyze_template.h"
 
 /*
-    Include state machines.
+    Include state machines.  The line break and cluster break machines are
+    run by the loops in ualyze_template.h.  The product machine combines both
+    machines into one, and is used if the build enables it.
 */
 
-#define ACTION signed char
-#define BREAK( x ) -x-1
-#define NO_BREAK( x ) +x
-#define LOOKAHEAD_NU( x ) -x-63
+#if defined( UAL_BREAK_PRODUCT )
 
-#include "uax14.h"
-#include "uax29p3.h"
+#include "uax_product.h"
 
-#undef ACTION
-#undef BREAK
-#undef NO_BREAK
+#endif
 
 /*
-    Run both state machines at the same time.
+    Optional lists of break positions.
 */
 
-const size_t NO_SPACE = SIZE_MAX;
+const unsigned BREAK_LIST_OPTIONS = UAL_OPTION_BREAK_LISTS | UAL_OPTION_BREAK_VARINT;
+
+static void break_lists_clear( ual_buffer* ub )
+{
+    for ( size_t i = 0; i < BREAK_LIST_COUNT; ++i )
+    {
+        ual_break_output* out = &ub->break_lists[ i ];
+        out->positions.clear();
+        out->varint.clear();
+        out->last = 0;
+        out->count = 0;
+    }
+}
+
+static void break_list_push( ual_buffer* ub, size_t ilist, size_t index )
+{
+    ual_break_output* out = &ub->break_lists[ ilist ];
+    out->count += 1;
+
+    if ( ub->options & UAL_OPTION_BREAK_LISTS )
+    {
+        out->positions.push_back( (ual_position)index );
+    }
+
+    if ( ub->options & UAL_OPTION_BREAK_VARINT )
+    {
+        assert( index >= out->last );
+        ual_index delta = (ual_index)index - out->last;
+        while ( delta >= 0x80 )
+        {
+            out->varint.push_back( (uint8_t)( delta | 0x80 ) );
+            delta >>= 7;
+        }
+        out->varint.push_back( (uint8_t)delta );
+        out->last = (ual_index)index;
+    }
+}
+
+const size_t LIST_CLUSTER = 0;
+const size_t LIST_LINE = 1;
+const size_t LIST_SPACES = 2;
+
+static_assert( UAL_BREAK_CLUSTER == 1 << LIST_CLUSTER );
+static_assert( UAL_BREAK_LINE == 1 << LIST_LINE );
+static_assert( UAL_BREAK_SPACES == 1 << LIST_SPACES );
+
+static void break_outputs( ual_buffer* ub, bool lists, bool clusters )
+{
+    // Build optional outputs from the break flags.
+    if ( lists )
+    {
+        break_lists_clear( ub );
+    }
+
+    if ( clusters )
+    {
+        cluster_index_begin( ub );
+    }
+
+    size_t length = ub->c.size();
+    for ( size_t i = 0; i < length; ++i )
+    {
+        unsigned bc = ub->c[ i ].bc;
+        if ( clusters && ( bc & UAL_BREAK_CLUSTER ) )
+        {
+            cluster_index_add( ub, i );
+        }
+        if ( lists )
+        {
+            if ( bc & UAL_BREAK_CLUSTER )
+                break_list_push( ub, LIST_CLUSTER, i );
+            if ( bc & UAL_BREAK_LINE )
+                break_list_push( ub, LIST_LINE, i );
+            if ( bc & UAL_BREAK_SPACES )
+                break_list_push( ub, LIST_SPACES, i );
+        }
+    }
+
+    if ( clusters )
+    {
+        cluster_index_end( ub );
+    }
+}
+
+/*
+    Cached break results are the break flags of each unit, packed two units
+    to a byte.  Lists and the cluster index are rebuilt from the flags.
+*/
+
+static bool break_cache_restore( ual_buffer* ub )
+{
+    const uint8_t* flags = cache_section( ub, CACHE_BREAKS );
+    if ( ! flags )
+    {
+        return false;
+    }
+
+    ual_char* c = ub->c.data();
+    size_t length = ub->c.size();
+    for ( size_t i = 0; i < length; ++i )
+    {
+        c[ i ].bc = ( flags[ i >> 1 ] >> ( ( i & 1 ) * 4 ) ) & 0xF;
+    }
+
+    bool lists = ( ub->options & BREAK_LIST_OPTIONS ) != 0;
+    bool clusters = ( ub->options & UAL_OPTION_CLUSTER_INDEX ) != 0;
+    if ( lists || clusters )
+    {
+        break_outputs( ub, lists, clusters );
+    }
+
+    ub->bc_usage = BC_BREAK_FLAGS;
+    ub->break_list_options = ub->options & BREAK_LIST_OPTIONS;
+    return true;
+}
+
+static void break_cache_store( ual_buffer* ub )
+{
+    const ual_char* c = ub->c.data();
+    size_t length = ub->c.size();
+    ub->cache_data.assign( ( length + 1 ) / 2, 0 );
+    for ( size_t i = 0; i < length; ++i )
+    {
+        ub->cache_data[ i >> 1 ] |= c[ i ].bc << ( ( i & 1 ) * 4 );
+    }
+    cache_insert( ub, CACHE_BREAKS, ub->cache_data );
+}
+
+#if defined( UAL_BREAK_PRODUCT )
+
+/*
+    Run the product machine.  There is one lookup per character.  When the
+    line breaking rules need to look ahead to see if the next character is
+    NU, the machine enters a pending state, and the transition on the next
+    character decides whether to break at the previous character.  Low
+    surrogates have a class which leaves the state unchanged.
+*/
+
+struct product_state
+{
+    unsigned state;
+    size_t iprev;
+    size_t space_index;
+    bool was_space;
+};
+
+const product_state PRODUCT_STATE_START = { PRODUCT_START, 0, 0, false };
+
+static inline void product_step( product_state* ps, ual_char* c, size_t i )
+{
+    // Read state machine.
+    size_t ix = std::min< size_t >( c[ i ].ix, PRODUCT_ENTRY_COUNT );
+    unsigned action = PRODUCT[ ps->state ][ PRODUCT_CLASS[ ix ] ];
+    ps->state = action >> PRODUCT_STATE_SHIFT;
+
+    // Set break flags, including a decision deferred from the previous
+    // non-surrogate character.
+    if ( action & PRODUCT_DEFER_LINE )
+    {
+        c[ ps->iprev ].bc |= UAL_BREAK_LINE;
+    }
+    c[ i ].bc = action & ( PRODUCT_CLUSTER | PRODUCT_LINE );
+
+    // Mark start of space run before each break opportunity.
+    bool opportunity = ( action & PRODUCT_OPPORTUNITY ) != 0;
+    if ( opportunity && ps->was_space )
+    {
+        c[ ps->space_index ].bc |= UAL_BREAK_SPACES;
+    }
+    bool was_space = ps->was_space && ! opportunity;
+
+    // Check for space.  Surrogates do not interrupt space runs.
+    bool is_space = ( action & PRODUCT_SPACE ) != 0;
+    bool skip = ( action & PRODUCT_SKIP ) != 0;
+    ps->space_index = ( is_space && ! was_space ) ? i : ps->space_index;
+    ps->was_space = skip ? was_space : is_space;
+    ps->iprev = skip ? ps->iprev : i;
+}
+
+static inline void product_end( product_state* ps, ual_char* c )
+{
+    // Lookahead at end of text finds no NU, so break.
+    if ( PRODUCT_PENDING[ ps->state ] )
+    {
+        c[ ps->iprev ].bc |= UAL_BREAK_LINE;
+    }
+
+    // Set last space index, if any.
+    if ( ps->was_space )
+    {
+        c[ ps->space_index ].bc |= UAL_BREAK_SPACES;
+    }
+}
+
+UAL_API void ual_analyze_breaks( ual_buffer* ub )
+{
+    UAL_PROBE1( breaks_begin, ub->c.size() );
+    stats_add( ub->stats.break_paragraphs, 1 );
+    stats_add( ub->stats.break_units, ub->c.size() );
+    uint64_t ticks = stats_ticks();
+
+    // Restore results for the same text from the cache.
+    if ( ub->cache && break_cache_restore( ub ) )
+    {
+        stats_lap( ub->stats.break_ticks, ticks );
+        UAL_PROBE1( breaks_end, ub->c.size() );
+        return;
+    }
+
+    product_state ps = PRODUCT_STATE_START;
+    ual_char* c = ub->c.data();
+    size_t length = ub->c.size();
+    for ( size_t i = 0; i < length; ++i )
+    {
+        product_step( &ps, c, i );
+    }
+    product_end( &ps, c );
+
+    bool lists = ( ub->options & BREAK_LIST_OPTIONS ) != 0;
+    bool clusters = ( ub->options & UAL_OPTION_CLUSTER_INDEX ) != 0;
+    if ( lists || clusters )
+    {
+        break_outputs( ub, lists, clusters );
+    }
+
+    ub->bc_usage = BC_BREAK_FLAGS;
+    ub->break_list_options = ub->options & BREAK_LIST_OPTIONS;
+    if ( ub->cache )
+    {
+        break_cache_store( ub );
+    }
+    stats_lap( ub->stats.break_ticks, ticks );
+    UAL_PROBE1( breaks_end, ub->c.size() );
+}
+
+#else
+
+/*
+    Run both state machines at the same time, using the per-character step of
+    the template front end with a sink which writes to the buffer.
+*/
+
+struct break_sink
+{
+    ual_buffer* ub;
+    bool lists;
+    bool clusters;
+    unsigned bc;                    // flags for the current character.
+
+    void cluster( size_t index )
+    {
+        bc |= UAL_BREAK_CLUSTER;
+        if ( clusters )
+        {
+            cluster_index_add( ub, index );
+        }
+        if ( lists )
+        {
+            break_list_push( ub, LIST_CLUSTER, index );
+        }
+    }
+
+    void line( size_t index )
+    {
+        bc |= UAL_BREAK_LINE;
+        if ( lists )
+        {
+            break_list_push( ub, LIST_LINE, index );
+        }
+    }
+
+    void spaces( size_t index )
+    {
+        assert( index != ual::detail::NO_SPACE );
+        ub->c[ index ].bc |= UAL_BREAK_SPACES;
+        if ( lists )
+        {
+            break_list_push( ub, LIST_SPACES, index );
+        }
+    }
+};
 
 static bool lookahead_nu( ual_buffer* ub, size_t index, size_t length )
 {
@@ -56,12 +334,30 @@ static bool lookahead_nu( ual_buffer* ub, size_t index, size_t length )
 
 UAL_API void ual_analyze_breaks( ual_buffer* ub )
 {
-    int lb_state = STATE_SOT_ZWJ;
-    int cb_state = STATE_CONTROL_LF;
+    UAL_PROBE1( breaks_begin, ub->c.size() );
+    stats_add( ub->stats.break_paragraphs, 1 );
+    stats_add( ub->stats.break_units, ub->c.size() );
+    uint64_t ticks = stats_ticks();
+
+    // Restore results for the same text from the cache.
+    if ( ub->cache && break_cache_restore( ub ) )
+    {
+        stats_lap( ub->stats.break_ticks, ticks );
+        UAL_PROBE1( breaks_end, ub->c.size() );
+        return;
+    }
 
-    size_t space_index = NO_SPACE;
-    bool was_space = false;
+    break_sink sink = { ub, ( ub->options & BREAK_LIST_OPTIONS ) != 0, ( ub->options & UAL_OPTION_CLUSTER_INDEX ) != 0, 0 };
+    if ( sink.lists )
+    {
+        break_lists_clear( ub );
+    }
+    if ( sink.clusters )
+    {
+        cluster_index_begin( ub );
+    }
 
+    ual::detail::break_state state = ual::detail::BREAK_START;
     size_t length = ub->c.size();
     for ( size_t i = 0; i < length; ++i )
     {
@@ -73,68 +369,202 @@ UAL_API void ual_analyze_breaks( ual_buffer* ub )
             continue;
         }
 
-        // Look up properties.
-        const ucdb_entry& uentry = UCDB_TABLE[ c.ix ];
-        unsigned lb_class = uentry.lbreak;
-        unsigned cb_class = uentry.cbreak;
+        // Spaces are flagged on an earlier character, so flag this character
+        // after the step.
+        sink.bc = 0;
+        auto lookahead = [ & ]() { return lookahead_nu( ub, i + 1, length ); };
+        ual::detail::break_step< ual::breaks >( &state, UCDB_TABLE[ c.ix ], i, lookahead, sink );
+        c.bc = sink.bc;
+    }
+    ual::detail::break_end< ual::breaks >( &state, sink );
+
+    if ( sink.clusters )
+    {
+        cluster_index_end( ub );
+    }
+
+    ub->bc_usage = BC_BREAK_FLAGS;
+    ub->break_list_options = ub->options & BREAK_LIST_OPTIONS;
+    if ( ub->cache )
+    {
+        break_cache_store( ub );
+    }
+    stats_lap( ub->stats.break_ticks, ticks );
+    UAL_PROBE1( breaks_end, ub->c.size() );
+}
+
+#endif
+
+/*
+    Fused analysis identifies a paragraph, runs the break machines, and looks
+    up initial bidi classes in a single pass over the text.  It runs the loop
+    of the template front end, with a sink which adds each character to the
+    buffer as ual_analyze_paragraph does, and runs the break machines as
+    ual_analyze_breaks does.  Bidi classes go to a separate array, which
+    ual_analyze_bidi copies instead of looking up each character again.
+*/
+
+struct fused_sink
+{
+    ual_buffer* ub;
+    size_t surrogate_units;
+    uint32_t classes;
+#if defined( UAL_BREAK_PRODUCT )
+    product_state ps;
+#else
+    size_t index;                   // current character.
+    unsigned bc;                    // flags for the current character.
+#endif
 
-        // Read state machine.
-        lb_state = UAX14[ lb_state ][ lb_class ];
-        cb_state = UAX29P3[ cb_state ][ cb_class ];
+    void character( size_t index, size_t next, unsigned ix, const ucdb_entry& uentry )
+    {
+#if ! defined( UAL_BREAK_PRODUCT )
+        flush();
+        this->index = index;
+#endif
+
+        // Look up initial bidi class.
+        unsigned bidi_class = bidi_initial_class( uentry );
+        classes |= 1u << bidi_class;
+        ub->bidi_classes.classes.push_back( (uint8_t)bidi_class );
 
-        // Determine break class.
-        unsigned bc = 0;
-        if ( lb_state < 0 )
+        // Add character, as ual_analyze_paragraph.
+        assert( ix < IX_INVALID );
+        ual_char uchar = {};
+        uchar.ix = ix;
+        ub->c.push_back( uchar );
+        if ( next - index > 1 )
         {
-            if ( lb_state > -62 )
-            {
-                lb_state = -lb_state-1;
-                bc |= UAL_BREAK_LINE;
-            }
-            else
-            {
-                lb_state = -lb_state-63;
-                if ( ! lookahead_nu( ub, i + 1, length ) )
-                {
-                    bc |= UAL_BREAK_LINE;
-                }
-            }
-
-            if ( was_space )
-            {
-                assert( space_index != NO_SPACE );
-                ub->c[ space_index ].bc |= UAL_BREAK_SPACES;
-            }
-
-            space_index = NO_SPACE;
-            was_space = false;
+            ub->bidi_classes.classes.push_back( BC_INVALID );
+            ub->c.push_back( { IX_INVALID, 0 } );
+            surrogate_units += 2;
         }
-        if ( cb_state < 0 )
+
+#if defined( UAL_BREAK_PRODUCT )
+        // Run the product machine over each unit.
+        ual_char* c = ub->c.data();
+        for ( ; index < next; ++index )
         {
-            bc |= UAL_BREAK_CLUSTER;
-            cb_state = -cb_state-1;
+            product_step( &ps, c, index );
         }
-        c.bc = bc;
-
-        // Check for space.
-        bool is_space =
-               uentry.zspace                    // space characters
-            || lb_class == UCDB_LBREAK_ZW       // ZERO WIDTH SPACE
-            || lb_state == STATE_NL_LF_CR_BK;   // newlines
-        if ( is_space && ! was_space )
+#endif
+    }
+
+#if ! defined( UAL_BREAK_PRODUCT )
+
+    void flush()
+    {
+        // Spaces are flagged on an earlier character, so only flag the
+        // current character once all of its breaks are known.
+        if ( bc )
         {
-            space_index = i;
+            ub->c[ index ].bc |= bc;
+            bc = 0;
         }
-        was_space = is_space;
     }
 
-    // Set last space index, if any.
-    if ( was_space )
+    void cluster( size_t index )
+    {
+        bc |= UAL_BREAK_CLUSTER;
+    }
+
+    void line( size_t index )
+    {
+        bc |= UAL_BREAK_LINE;
+    }
+
+    void spaces( size_t index )
+    {
+        assert( index != ual::detail::NO_SPACE );
+        ub->c[ index ].bc |= UAL_BREAK_SPACES;
+    }
+
+#endif
+};
+
+UAL_API size_t ual_analyze_all( ual_buffer* ub, const char16_t* text, size_t size )
+{
+    // Cached results are found for whole paragraphs, so use separate passes.
+    if ( ub->cache || ! text || ! size )
+    {
+        size_t length = ual_analyze_paragraph( ub, text, size );
+        ual_analyze_breaks( ub );
+        return length;
+    }
+
+    UAL_PROBE1( paragraph_begin, size );
+    uint64_t ticks = stats_ticks();
+
+    ub->c.clear();
+    ub->cache_record.reset();
+    ub->bc_usage = BC_NONE;
+    ub->break_list_options = 0;
+    ub->cluster_index.valid = false;
+    ub->bidi_analysis.valid = false;
+    ub->bidi_classes.classes.clear();
+    ub->bidi_classes.valid = false;
+
+    // Perform analysis.
+#if defined( UAL_BREAK_PRODUCT )
+    fused_sink sink = { ub, 0, 0, PRODUCT_STATE_START };
+    size_t length = ual::detail::paragraph_breaks< ual::detail::chars, ual::detail::library_tables >( text, size, 0, sink );
+    product_end( &sink.ps, ub->c.data() );
+#else
+    fused_sink sink = { ub, 0, 0, 0, 0 };
+    size_t length = ual::detail::paragraph_breaks< ual::detail::chars | ual::breaks, ual::detail::library_tables >( text, size, 0, sink );
+    sink.flush();
+#endif
+    assert( ub->c.size() == length );
+
+    bool lists = ( ub->options & BREAK_LIST_OPTIONS ) != 0;
+    bool clusters = ( ub->options & UAL_OPTION_CLUSTER_INDEX ) != 0;
+    if ( lists || clusters )
     {
-        assert( space_index != NO_SPACE );
-        ub->c[ space_index ].bc |= UAL_BREAK_SPACES;
+        break_outputs( ub, lists, clusters );
     }
 
+    ub->text = std::u16string_view( text, length );
     ub->bc_usage = BC_BREAK_FLAGS;
+    ub->break_list_options = ub->options & BREAK_LIST_OPTIONS;
+    ub->bidi_classes.complexity = bidi_classify( sink.classes );
+    ub->bidi_classes.valid = true;
+
+    stats_add( ub->stats.break_paragraphs, 1 );
+    stats_add( ub->stats.break_units, length );
+    stats_lap( ub->stats.break_ticks, ticks );
+
+    if ( workload_active() )
+    {
+        workload_paragraph( length, sink.surrogate_units );
+    }
+
+    UAL_PROBE1( paragraph_end, length );
+    return length;
+}
+
+UAL_API bool ual_break_list_get( ual_buffer* ub, uint16_t break_flag, ual_break_list* out_list )
+{
+    // Find list for flag.
+    size_t ilist = 0;
+    while ( ilist < BREAK_LIST_COUNT && break_flag != 1 << ilist )
+    {
+        ilist += 1;
+    }
+
+    // Check that lists were built by the last break analysis.
+    if ( ilist >= BREAK_LIST_COUNT || ! ub->break_list_options )
+    {
+        *out_list = { 0, nullptr, nullptr, 0 };
+        return false;
+    }
+
+    const ual_break_output& out = ub->break_lists[ ilist ];
+    bool positions = ( ub->break_list_options & UAL_OPTION_BREAK_LISTS ) != 0;
+    bool varint = ( ub->break_list_options & UAL_OPTION_BREAK_VARINT ) != 0;
+    out_list->count = out.count;
+    out_list->positions = positions ? out.positions.data() : nullptr;
+    out_list->varint = varint ? out.varint.data() : nullptr;
+    out_list->varint_size = varint ? out.varint.size() : 0;
+    return true;
 }
 
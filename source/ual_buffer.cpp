@@ -14,13 +14,22 @@
 ual_buffer::ual_buffer()
     :   refcount( 1 )
     ,   bc_usage( BC_NONE )
-    ,   script_analysis{ INVALID_INDEX }
-    ,   bidi_analysis{ INVALID_INDEX, INVALID_INDEX }
+    ,   options( 0 )
+    ,   break_list_options( 0 )
+    ,   cluster_index{ {}, {}, {}, false }
+    ,   script_analysis{ INVALID_INDEX, 0, 0, 0, INVALID_INDEX }
+    ,   bidi_analysis{ INVALID_INDEX, INVALID_INDEX, 0, BIDI_ALL_LEFT, false }
+    ,   bidi_classes{ {}, BIDI_ALL_LEFT, false }
+    ,   stats{}
+    ,   cache( nullptr )
+    ,   cache_key( 0 )
+    ,   line_index( INVALID_INDEX )
 {
 }
 
 ual_buffer::~ual_buffer()
 {
+    ual_cache_release( cache );
 }
 
 UAL_API ual_buffer* ual_buffer_create()
@@ -42,6 +51,11 @@ UAL_API void ual_buffer_release( ual_buffer* ub )
     }
 }
 
+UAL_API void ual_buffer_options( ual_buffer* ub, unsigned options )
+{
+    ub->options = options;
+}
+
 UAL_API const char16_t* ual_buffer_text( ual_buffer* ub )
 {
     return ub->text.data();
@@ -57,34 +71,35 @@ UAL_API size_t ual_buffer_size( ual_buffer* ub )
     return ub->text.size();
 }
 
-char32_t ual_codepoint( ual_buffer* ub, size_t index )
+UAL_API bool ual_buffer_stats( ual_buffer* ub, ual_stats* out_stats )
 {
-    assert( index < ub->text.size() );
-    char32_t uc = ub->text[ index ];
+    *out_stats = ub->stats;
+#if defined( UAL_STATS )
+    return true;
+#else
+    return false;
+#endif
+}
+
+UAL_API void ual_buffer_stats_reset( ual_buffer* ub )
+{
+    ub->stats = {};
+}
 
-    // Check for surrogate.
-    if ( ( uc & 0xF800 ) == 0xD800 )
+UAL_API void ual_stats_add( ual_stats* total, const ual_stats* stats )
+{
+    const uint64_t* counters = (const uint64_t*)stats;
+    uint64_t* totals = (uint64_t*)total;
+    for ( size_t i = 0; i < sizeof( ual_stats ) / sizeof( uint64_t ); ++i )
     {
-        // Get next code unit.
-        char32_t ul = index < ub->text.size() ? ub->text[ index ] : 0;
-
-        // Check for high/low surrogate pair.
-        bool have_hi_surrogate = ( uc & 0xFC00 ) == 0xD800;
-        bool have_lo_surrogate = ( ul & 0xFC00 ) == 0xDC00;
-        if ( have_hi_surrogate && have_lo_surrogate )
-        {
-            // Decode surrogate pair.
-            uc = 0x010000 + ( ( uc & 0x3FF ) << 10 ) + ( ul & 0x3FF );
-            index += 1;
-        }
-        else
-        {
-            // Treat lone surrogates as U+FFFD REPLACEMENT CHARACTER.
-            uc = 0xFFFD;
-        }
+        totals[ i ] += counters[ i ];
     }
+}
 
-    return uc;
+char32_t ual_codepoint( ual_buffer* ub, size_t index )
+{
+    assert( index < ub->text.size() );
+    return ual_decode( ub->text.data(), ub->text.size(), &index );
 }
 
 
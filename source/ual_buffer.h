@@ -12,11 +12,44 @@
 #define UAL_BUFFER_H
 
 #include "ualyze.h"
+#include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
 #include "ucdb_table.h"
 
-const uint16_t IX_INVALID = ( 1 << 11 ) - 1;
+#if defined( UAL_PROBES )
+#include <sys/sdt.h>
+#endif
+
+#if defined( UAL_STATS )
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#elif defined( _M_X64 ) || defined( _M_IX86 )
+#include <intrin.h>
+#else
+#include <chrono>
+#endif
+#endif
+
+/*
+    By default, internal structures use 32-bit paragraph offsets and 20-bit
+    links between level runs, and ual_char::ix has 11 bits.  UAL_WIDE selects
+    64-bit offsets, 32-bit links, and a 24-bit ix, for very large paragraphs.
+*/
+
+#if defined( UAL_WIDE )
+typedef uint64_t ual_index;
+const unsigned LINK_BITS = 32;
+const unsigned IX_BITS = 24;
+#else
+typedef uint32_t ual_index;
+const unsigned LINK_BITS = 20;
+const unsigned IX_BITS = 11;
+#endif
+
+const uint32_t IX_INVALID = ( 1u << IX_BITS ) - 1;
+const uint32_t LINK_INVALID = ~0u >> ( 32 - LINK_BITS );
 
 const unsigned BC_SEQUENCE = 3;
 
@@ -24,7 +57,7 @@ const uint16_t BC_BRACKET = 30;
 const uint16_t BC_INVALID = 31;
 
 const size_t INVALID_INDEX = ~(size_t)0;
-const size_t STACK_BYTES = sizeof( unsigned ) * 128;
+const size_t STACK_BYTES = sizeof( ual_index ) * 128;
 
 enum ual_bc_usage
 {
@@ -38,30 +71,99 @@ struct ual_script_analysis
     size_t index;
     unsigned script;
     unsigned sp;
+    size_t spans;
+    size_t replay;      // offset of next span in cached record, or INVALID_INDEX.
 };
 
 enum ual_bidi_complexity
 {
     BIDI_ALL_LEFT,  // Paragraph is left-to-right.
+    BIDI_ALL_RIGHT, // Paragraph is right-to-left, with no numbers.
+    BIDI_STRONG,    // Only strong characters and whitespace.
     BIDI_SOLITARY,  // No directional embeddings, overrides, or isolates.
+    BIDI_ISOLATES,  // Isolates, but no embeddings or overrides.
     BIDI_EXPLICIT,  // Requires full processing.
 };
 
 struct ual_bidi_analysis
 {
-    size_t ilrun;
-    size_t index;
+    size_t irun;
+    size_t isequence;
     unsigned paragraph_level;
     ual_bidi_complexity complexity;
+    bool valid;
+};
+
+struct ual_bidi_classes
+{
+    std::vector< uint8_t > classes;     // initial bidi class of each unit.
+    ual_bidi_complexity complexity;
+    bool valid;
 };
 
 struct ual_level_run
 {
-    unsigned start;         // index of first character in run.
-    unsigned level  : 8;    // bidi level of run.
-    unsigned sos    : 2;    // sos type (L, R, AL, or BC_SEQUENCE).
-    unsigned eos    : 2;    // eos type (L, R, AL, or BC_SEQUENCE).
-    unsigned inext  : 20;   // index of next level run in isolating sequence.
+    ual_index start;                // index of first character in run.
+    unsigned level  : 8;            // bidi level of run.
+    unsigned sos    : 2;            // sos type (L, R, AL, or BC_SEQUENCE).
+    unsigned eos    : 2;            // eos type (L, R, AL, or BC_SEQUENCE).
+    unsigned inext  : LINK_BITS;    // index of next level run in isolating sequence.
+};
+
+struct ual_bidi_entry
+{
+    ual_index lower;        // index of first character in run.
+    unsigned level;         // bidi level of run.
+    ual_index imirror;      // index of first mirrored character in run.
+};
+
+struct ual_break_output
+{
+    std::vector< ual_position > positions;
+    std::vector< uint8_t > varint;
+    ual_index last;
+    size_t count;
+};
+
+const size_t BREAK_LIST_COUNT = 3;
+
+struct ual_cluster_index
+{
+    std::vector< uint64_t > bits;       // bit set at the start of each cluster.
+    std::vector< ual_index > ranks;     // number of clusters before each word.
+    std::vector< ual_index > starts;    // index of start of each cluster.
+    bool valid;
+};
+
+struct ual_fit_break
+{
+    ual_index index;        // index of character which would start the next line.
+    ual_index spaces;       // index of first trailing space before the break.
+    double width;           // width of text before trailing spaces.
+    double total;           // width of text before index.
+    double glue;            // width of all trailing spaces up to and including this break.
+};
+
+struct ual_fit_node
+{
+    size_t overfull;        // number of lines which overflow in best fit ending at this break.
+    double demerits;        // total demerits of the lines which do not overflow.
+    ual_index iprev;        // index of break which starts the last line.
+};
+
+struct ual_cache_section
+{
+    uint64_t kind;
+    size_t offset;
+    size_t size;
+};
+
+struct ual_cache_record
+{
+    uint64_t key;
+    std::u16string text;
+    std::vector< ual_cache_section > sections;
+    std::vector< uint8_t > data;
 };
 
 struct ual_buffer
@@ -76,11 +178,41 @@ struct ual_buffer
     std::u16string_view text;
     std::vector< ual_char > c;
     ual_bc_usage bc_usage;
+    unsigned options;
+
+    // Break lists, indexed by bit number of break flag.
+    unsigned break_list_options;
+    ual_break_output break_lists[ BREAK_LIST_COUNT ];
+
+    // Cluster index.
+    ual_cluster_index cluster_index;
 
     // Current analysis state.
     ual_script_analysis script_analysis;
     ual_bidi_analysis bidi_analysis;
     std::vector< ual_level_run > level_runs;
+    std::vector< ual_bidi_entry > bidi_runs;
+    std::vector< ual_bidi_mirror > bidi_mirrors;
+    std::vector< ual_bidi_range > bidi_ranges;
+
+    // Initial bidi classes looked up by ual_analyze_all.
+    ual_bidi_classes bidi_classes;
+
+    // Instrumentation.
+    ual_stats stats;
+
+    // Result cache.
+    ual_cache* cache;
+    uint64_t cache_key;
+    std::shared_ptr< const ual_cache_record > cache_record;
+    std::vector< uint8_t > cache_data;
+    std::vector< uint8_t > script_data;
+
+    // Line fitting.
+    std::vector< ual_fit_break > fit_breaks;
+    std::vector< ual_fit_node > fit_nodes;
+    std::vector< ual_line > lines;
+    size_t line_index;
 
     // Stack bytes.
     char stack_bytes[ STACK_BYTES ];
@@ -88,6 +220,168 @@ struct ual_buffer
 
 char32_t ual_codepoint( ual_buffer* ub, size_t index );
 
+/*
+    Instrumentation compiles to nothing unless UAL_STATS is defined.
+*/
+
+inline uint64_t stats_ticks()
+{
+#if defined( UAL_STATS )
+#if defined( __x86_64__ ) || defined( __i386__ ) || defined( _M_X64 ) || defined( _M_IX86 )
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+#endif
+#else
+    return 0;
+#endif
+}
+
+inline void stats_add( uint64_t& counter, uint64_t value )
+{
+#if defined( UAL_STATS )
+    counter += value;
+#endif
+}
+
+inline uint64_t stats_lap( uint64_t& counter, uint64_t start )
+{
+    // Add ticks since start to counter, and return the current tick.
+    uint64_t ticks = stats_ticks();
+    stats_add( counter, ticks - start );
+    return ticks;
+}
+
+inline char32_t ual_decode( const char16_t* text, size_t size, size_t* inout_index )
+{
+    size_t index = *inout_index;
+    char32_t uc = text[ index++ ];
+
+    // Check for surrogate.
+    if ( ( uc & 0xF800 ) == 0xD800 )
+    {
+        // Get next code unit.
+        char32_t ul = index < size ? text[ index ] : 0;
+
+        // Check for high/low surrogate pair.
+        bool have_hi_surrogate = ( uc & 0xFC00 ) == 0xD800;
+        bool have_lo_surrogate = ( ul & 0xFC00 ) == 0xDC00;
+        if ( have_hi_surrogate && have_lo_surrogate )
+        {
+            // Decode surrogate pair.
+            uc = 0x010000 + ( ( uc & 0x3FF ) << 10 ) + ( ul & 0x3FF );
+            index += 1;
+        }
+        else
+        {
+            // Treat lone surrogates as U+FFFD REPLACEMENT CHARACTER.
+            uc = 0xFFFD;
+        }
+    }
+
+    *inout_index = index;
+    return uc;
+}
+
+inline unsigned bidi_initial_class( const ucdb_entry& entry )
+{
+    // Paired brackets are distinguished from other neutrals.
+    unsigned bc = entry.bclass;
+    if ( bc == UCDB_BIDI_ON && entry.paired )
+    {
+        bc = BC_BRACKET;
+    }
+    return bc;
+}
+
+ual_bidi_complexity bidi_classify( uint32_t classes );
+
+/*
+    LEB128 varints, used by the result cache, archives, and skeletons.
+*/
+
+inline void push_varint( std::vector< uint8_t >* data, size_t value )
+{
+    while ( value >= 0x80 )
+    {
+        data->push_back( (uint8_t)( value | 0x80 ) );
+        value >>= 7;
+    }
+    data->push_back( (uint8_t)value );
+}
+
+inline size_t read_varint( const uint8_t** p )
+{
+    size_t value = 0;
+    unsigned shift = 0;
+    while ( **p & 0x80 )
+    {
+        value |= (size_t)( *( *p )++ & 0x7F ) << shift;
+        shift += 7;
+    }
+    value |= (size_t)*( *p )++ << shift;
+    return value;
+}
+
+/*
+    The result cache holds a record for each paragraph text, which is looked
+    up when the paragraph is identified.  The record has a section for each
+    kind of analysis, which encodes its results in its own format.
+*/
+
+const uint64_t CACHE_BREAKS = 0;
+const uint64_t CACHE_SCRIPTS = 1;
+const uint64_t CACHE_BIDI = 2;
+
+void cache_paragraph( ual_buffer* ub );
+const uint8_t* cache_section( ual_buffer* ub, uint64_t kind );
+void cache_insert( ual_buffer* ub, uint64_t kind, const std::vector< uint8_t >& data );
+
+void cluster_index_begin( ual_buffer* ub );
+void cluster_index_end( ual_buffer* ub );
+
+inline void cluster_index_add( ual_buffer* ub, size_t index )
+{
+    ual_cluster_index* ci = &ub->cluster_index;
+    ci->bits[ index >> 6 ] |= (uint64_t)1 << ( index & 63 );
+    ci->starts.push_back( (ual_index)index );
+}
+
+void fit_breaks( ual_buffer* ub, const float* advances );
+void fit_greedy( const ual_fit_break* breaks, size_t count, const ual_fit_params* params, std::vector< ual_line >* lines );
+void fit_optimal( const ual_fit_break* breaks, size_t count, const ual_fit_params* params, std::vector< ual_fit_node >* nodes, std::vector< ual_line >* lines );
+
+/*
+    USDT probes in the 'ualyze' provider, for perf and bpftrace.  A probe site
+    is a single nop until a tracer attaches.  Without UAL_PROBES they compile
+    to nothing.
+*/
+
+#if defined( UAL_PROBES )
+#define UAL_PROBE1( name, a ) DTRACE_PROBE1( ualyze, name, a )
+#define UAL_PROBE2( name, a, b ) DTRACE_PROBE2( ualyze, name, a, b )
+#define UAL_PROBE3( name, a, b, c ) DTRACE_PROBE3( ualyze, name, a, b, c )
+#else
+#define UAL_PROBE1( name, a ) ( (void)0 )
+#define UAL_PROBE2( name, a, b ) ( (void)0 )
+#define UAL_PROBE3( name, a, b, c ) ( (void)0 )
+#endif
+
+/*
+    Workload statistics are recorded only while collection is enabled.
+*/
+
+extern std::atomic< bool > workload_enabled;
+
+inline bool workload_active()
+{
+    return workload_enabled.load( std::memory_order_relaxed );
+}
+
+void workload_paragraph( size_t length, size_t surrogate_units );
+void workload_complexity( unsigned complexity );
+void workload_script_spans( size_t spans );
+
 template < typename T, size_t count >
 inline T* ual_stack( ual_buffer* ub )
 {
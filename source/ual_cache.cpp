@@ -0,0 +1,315 @@
+//
+//  ual_cache.cpp
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include "ual_buffer.h"
+#include <assert.h>
+#include <string.h>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+/*
+    The cache is split into shards by the top bits of the key, each with its
+    own lock and its own share of the memory budget.  Each shard keeps its
+    records in least-recently-used order.
+
+    There is one record for each paragraph, found by a single lookup when the
+    paragraph is identified.  Records are immutable once inserted, and are
+    shared with buffers, so a buffer can decode a record after the shard lock
+    is released, even if it is evicted.  Adding the results of another kind
+    of analysis replaces the record with an extended copy, which merges in
+    any sections that other buffers have added to the shard's record.
+*/
+
+const size_t CACHE_SHARD_BITS = 4;
+const size_t CACHE_SHARD_COUNT = 1 << CACHE_SHARD_BITS;
+
+// Estimate of the bookkeeping overhead of each record.
+const size_t CACHE_RECORD_OVERHEAD = sizeof( ual_cache_record ) + 96;
+
+typedef std::shared_ptr< const ual_cache_record > ual_cache_pointer;
+typedef std::list< ual_cache_pointer > ual_cache_lru;
+
+struct ual_cache_shard
+{
+    std::mutex mutex;
+    ual_cache_lru lru;
+    std::unordered_map< uint64_t, ual_cache_lru::iterator > index;
+    size_t memory;
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t insertions;
+    uint64_t evictions;
+};
+
+struct ual_cache
+{
+    std::atomic< intptr_t > refcount;
+    size_t memory_budget;
+    size_t shard_budget;
+    ual_cache_shard shards[ CACHE_SHARD_COUNT ];
+};
+
+static size_t cache_record_memory( const ual_cache_record* record )
+{
+    return CACHE_RECORD_OVERHEAD
+        + record->text.size() * sizeof( char16_t )
+        + record->sections.size() * sizeof( ual_cache_section )
+        + record->data.size();
+}
+
+static ual_cache_shard* cache_shard( ual_cache* cache, uint64_t key )
+{
+    return &cache->shards[ key >> ( 64 - CACHE_SHARD_BITS ) ];
+}
+
+static uint64_t cache_hash( const char16_t* text, size_t size )
+{
+    // Hash four code units at a time.
+    uint64_t h = size * 0x9E3779B97F4A7C15ull;
+    size_t i = 0;
+    for ( ; i + 4 <= size; i += 4 )
+    {
+        uint64_t word;
+        memcpy( &word, text + i, sizeof( word ) );
+        h = ( h ^ word ) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 29;
+    }
+    for ( ; i < size; ++i )
+    {
+        h = ( h ^ text[ i ] ) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 29;
+    }
+
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+void cache_paragraph( ual_buffer* ub )
+{
+    assert( ub->cache );
+    ub->cache_record.reset();
+    ub->cache_key = cache_hash( ub->text.data(), ub->text.size() );
+    if ( ub->text.empty() )
+    {
+        return;
+    }
+
+    ual_cache_shard* shard = cache_shard( ub->cache, ub->cache_key );
+    std::lock_guard< std::mutex > lock( shard->mutex );
+    shard->lookups += 1;
+
+    auto i = shard->index.find( ub->cache_key );
+    if ( i == shard->index.end() )
+    {
+        return;
+    }
+
+    // The key is a hash, so check that the record really matches.
+    const ual_cache_pointer& record = *i->second;
+    if ( record->text != ub->text )
+    {
+        return;
+    }
+
+    // Move to most recently used.
+    shard->lru.splice( shard->lru.begin(), shard->lru, i->second );
+    shard->hits += 1;
+    ub->cache_record = record;
+}
+
+const uint8_t* cache_section( ual_buffer* ub, uint64_t kind )
+{
+    if ( ! ub->cache_record )
+    {
+        return nullptr;
+    }
+
+    for ( const ual_cache_section& section : ub->cache_record->sections )
+    {
+        if ( section.kind == kind )
+        {
+            return ub->cache_record->data.data() + section.offset;
+        }
+    }
+
+    return nullptr;
+}
+
+static bool cache_has_section( const ual_cache_record* record, uint64_t kind )
+{
+    for ( const ual_cache_section& section : record->sections )
+    {
+        if ( section.kind == kind )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void cache_add_section( ual_cache_record* record, uint64_t kind, const uint8_t* data, size_t size )
+{
+    record->sections.push_back( { kind, record->data.size(), size } );
+    record->data.insert( record->data.end(), data, data + size );
+}
+
+void cache_insert( ual_buffer* ub, uint64_t kind, const std::vector< uint8_t >& data )
+{
+    assert( ub->cache );
+    ual_cache* cache = ub->cache;
+    if ( ub->text.empty() )
+    {
+        return;
+    }
+
+    ual_cache_shard* shard = cache_shard( cache, ub->cache_key );
+    std::lock_guard< std::mutex > lock( shard->mutex );
+
+    // Find the current record for this text, which another buffer may have
+    // extended since this buffer looked it up.
+    const ual_cache_record* current = nullptr;
+    auto i = shard->index.find( ub->cache_key );
+    if ( i != shard->index.end() && ( *i->second )->text == ub->text )
+    {
+        current = i->second->get();
+    }
+
+    if ( current && cache_has_section( current, kind ) )
+    {
+        return;
+    }
+
+    // Extend a copy of this buffer's record, so that offsets into it remain
+    // valid, with the sections of the current record that it lacks.
+    auto record = std::make_shared< ual_cache_record >();
+    if ( ub->cache_record )
+    {
+        *record = *ub->cache_record;
+    }
+    else
+    {
+        record->key = ub->cache_key;
+        record->text = ub->text;
+    }
+
+    if ( current )
+    {
+        for ( const ual_cache_section& section : current->sections )
+        {
+            if ( ! cache_has_section( record.get(), section.kind ) )
+            {
+                cache_add_section( record.get(), section.kind, current->data.data() + section.offset, section.size );
+            }
+        }
+    }
+
+    if ( ! cache_has_section( record.get(), kind ) )
+    {
+        cache_add_section( record.get(), kind, data.data(), data.size() );
+    }
+
+    size_t memory = cache_record_memory( record.get() );
+    if ( memory > cache->shard_budget )
+    {
+        return;
+    }
+
+    ub->cache_record = record;
+
+    // Replace the current record, or a record with a colliding key.
+    if ( i != shard->index.end() )
+    {
+        shard->memory -= cache_record_memory( i->second->get() );
+        shard->lru.erase( i->second );
+        shard->index.erase( i );
+    }
+
+    // Evict least recently used records until the new record fits.
+    while ( shard->memory + memory > cache->shard_budget )
+    {
+        const ual_cache_pointer& victim = shard->lru.back();
+        shard->memory -= cache_record_memory( victim.get() );
+        shard->index.erase( victim->key );
+        shard->lru.pop_back();
+        shard->evictions += 1;
+    }
+
+    shard->lru.push_front( std::move( record ) );
+    shard->index.emplace( shard->lru.front()->key, shard->lru.begin() );
+    shard->memory += memory;
+    shard->insertions += 1;
+}
+
+UAL_API ual_cache* ual_cache_create( size_t memory_budget )
+{
+    ual_cache* cache = new ual_cache();
+    cache->refcount = 1;
+    cache->memory_budget = memory_budget;
+    cache->shard_budget = memory_budget / CACHE_SHARD_COUNT;
+    for ( size_t i = 0; i < CACHE_SHARD_COUNT; ++i )
+    {
+        ual_cache_shard* shard = &cache->shards[ i ];
+        shard->memory = 0;
+        shard->lookups = 0;
+        shard->hits = 0;
+        shard->insertions = 0;
+        shard->evictions = 0;
+    }
+    return cache;
+}
+
+UAL_API ual_cache* ual_cache_retain( ual_cache* cache )
+{
+    cache->refcount.fetch_add( 1, std::memory_order_relaxed );
+    return cache;
+}
+
+UAL_API void ual_cache_release( ual_cache* cache )
+{
+    if ( cache && cache->refcount.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+    {
+        delete cache;
+    }
+}
+
+UAL_API void ual_cache_stats_get( ual_cache* cache, ual_cache_stats* out_stats )
+{
+    *out_stats = {};
+    out_stats->memory_budget = cache->memory_budget;
+    for ( size_t i = 0; i < CACHE_SHARD_COUNT; ++i )
+    {
+        ual_cache_shard* shard = &cache->shards[ i ];
+        std::lock_guard< std::mutex > lock( shard->mutex );
+        out_stats->lookups += shard->lookups;
+        out_stats->hits += shard->hits;
+        out_stats->insertions += shard->insertions;
+        out_stats->evictions += shard->evictions;
+        out_stats->entries += shard->lru.size();
+        out_stats->memory += shard->memory;
+    }
+}
+
+UAL_API void ual_buffer_cache( ual_buffer* ub, ual_cache* cache )
+{
+    if ( cache )
+    {
+        ual_cache_retain( cache );
+    }
+    ual_cache_release( ub->cache );
+    ub->cache = cache;
+    ub->cache_record.reset();
+    if ( cache )
+    {
+        cache_paragraph( ub );
+    }
+}
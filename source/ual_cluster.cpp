@@ -0,0 +1,118 @@
+//
+//  ual_cluster.cpp
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include "ualyze.h"
+#include <assert.h>
+#include "ual_buffer.h"
+
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+
+/*
+    The cluster index is a rank/select structure over a bitmap with one bit
+    per encoding unit, set at the start of each cluster.  Rank is answered
+    using the count of clusters before each 64-bit word plus a popcount
+    within the word.  Select is answered by the list of cluster starts.
+*/
+
+static unsigned popcount( uint64_t bits )
+{
+#if defined( __GNUC__ )
+    return __builtin_popcountll( bits );
+#elif defined( _MSC_VER ) && defined( _M_X64 )
+    return (unsigned)__popcnt64( bits );
+#else
+    bits = bits - ( ( bits >> 1 ) & 0x5555555555555555 );
+    bits = ( bits & 0x3333333333333333 ) + ( ( bits >> 2 ) & 0x3333333333333333 );
+    bits = ( bits + ( bits >> 4 ) ) & 0x0F0F0F0F0F0F0F0F;
+    return (unsigned)( ( bits * 0x0101010101010101 ) >> 56 );
+#endif
+}
+
+void cluster_index_begin( ual_buffer* ub )
+{
+    ual_cluster_index* ci = &ub->cluster_index;
+    ci->bits.assign( ( ub->c.size() >> 6 ) + 1, 0 );
+    ci->starts.clear();
+    ci->valid = false;
+}
+
+void cluster_index_end( ual_buffer* ub )
+{
+    ual_cluster_index* ci = &ub->cluster_index;
+    ci->ranks.resize( ci->bits.size() );
+
+    ual_index rank = 0;
+    for ( size_t i = 0; i < ci->bits.size(); ++i )
+    {
+        ci->ranks[ i ] = rank;
+        rank += popcount( ci->bits[ i ] );
+    }
+
+    assert( rank == ci->starts.size() );
+    ci->valid = true;
+}
+
+UAL_API size_t ual_cluster_count( ual_buffer* ub )
+{
+    assert( ub->cluster_index.valid );
+    return ub->cluster_index.starts.size();
+}
+
+UAL_API size_t ual_cluster_of( ual_buffer* ub, size_t index )
+{
+    const ual_cluster_index* ci = &ub->cluster_index;
+    assert( ci->valid );
+
+    if ( index >= ub->c.size() )
+    {
+        return ci->starts.size();
+    }
+
+    // Count cluster starts at or before index.
+    size_t word = index >> 6;
+    uint64_t mask = ( (uint64_t)2 << ( index & 63 ) ) - 1;
+    size_t rank = ci->ranks[ word ] + popcount( ci->bits[ word ] & mask );
+    assert( rank > 0 );
+    return rank - 1;
+}
+
+UAL_API size_t ual_cluster_start( ual_buffer* ub, size_t cluster )
+{
+    const ual_cluster_index* ci = &ub->cluster_index;
+    assert( ci->valid );
+    return cluster < ci->starts.size() ? ci->starts[ cluster ] : ub->c.size();
+}
+
+UAL_API size_t ual_cluster_next( ual_buffer* ub, size_t index )
+{
+    if ( index >= ub->c.size() )
+    {
+        return ub->c.size();
+    }
+
+    return ual_cluster_start( ub, ual_cluster_of( ub, index ) + 1 );
+}
+
+UAL_API size_t ual_cluster_prev( ual_buffer* ub, size_t index )
+{
+    if ( index == 0 )
+    {
+        return 0;
+    }
+
+    if ( index > ub->c.size() )
+    {
+        index = ub->c.size();
+    }
+
+    return ual_cluster_start( ub, ual_cluster_of( ub, index - 1 ) );
+}
@@ -0,0 +1,266 @@
+//
+//  ual_fit.cpp
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include "ualyze.h"
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include "ual_buffer.h"
+
+/*
+    Build the list of break opportunities from break flags.  The first entry
+    is the start of the paragraph, and the last entry is the end of the
+    paragraph, which is a mandatory break.  Widths are running totals, so the
+    width of any line can be calculated with a subtraction.
+*/
+
+const size_t FIT_DEFAULT_WINDOW = 512;
+
+void fit_breaks( ual_buffer* ub, const float* advances )
+{
+    assert( ub->bc_usage == BC_BREAK_FLAGS );
+
+    ub->fit_breaks.clear();
+    ub->fit_breaks.push_back( { 0, 0, 0.0, 0.0, 0.0 } );
+
+    size_t spaces = INVALID_INDEX;
+    double spaces_width = 0.0;
+    double total = 0.0;
+    double glue = 0.0;
+
+    size_t length = ub->c.size();
+    for ( size_t index = 0; index < length; ++index )
+    {
+        uint16_t bc = ub->c[ index ].bc;
+
+        // Break opportunity before this character.
+        if ( ( bc & UAL_BREAK_LINE ) && index > 0 )
+        {
+            double width = spaces != INVALID_INDEX ? spaces_width : total;
+            glue += total - width;
+            ub->fit_breaks.push_back( { (ual_index)index, (ual_index)( spaces != INVALID_INDEX ? spaces : index ), width, total, glue } );
+            spaces = INVALID_INDEX;
+        }
+
+        // Start of run of spaces before the next break opportunity.
+        if ( bc & UAL_BREAK_SPACES )
+        {
+            spaces = index;
+            spaces_width = total;
+        }
+
+        total += advances[ index ];
+    }
+
+    // End of paragraph.
+    double width = spaces != INVALID_INDEX ? spaces_width : total;
+    glue += total - width;
+    ub->fit_breaks.push_back( { (ual_index)length, (ual_index)( spaces != INVALID_INDEX ? spaces : length ), width, total, glue } );
+}
+
+/*
+    Measure the line between two break opportunities.  Only the glue from
+    break opportunities inside the line can stretch or shrink.
+*/
+
+static ual_line fit_line( const ual_fit_break* breaks, size_t ilower, size_t iupper, const ual_fit_params* params, bool last )
+{
+    const ual_fit_break& lower = breaks[ ilower ];
+    const ual_fit_break& upper = breaks[ iupper ];
+
+    double width = upper.width - lower.total;
+    double glue = breaks[ iupper - 1 ].glue - lower.glue;
+
+    double ratio = 0.0;
+    double shortfall = params->width - width;
+    if ( shortfall > 0.0 && ! last )
+    {
+        double stretch = glue * params->stretch;
+        ratio = stretch > 0.0 ? shortfall / stretch : INFINITY;
+    }
+    else if ( shortfall < 0.0 )
+    {
+        double shrink = glue * params->shrink;
+        ratio = shrink > 0.0 ? shortfall / shrink : -INFINITY;
+    }
+
+    return { lower.index, upper.index, upper.spaces, (float)width, (float)ratio };
+}
+
+static double fit_demerits( const ual_line& line, const ual_fit_params* params, bool last )
+{
+    // Client demerits.
+    if ( params->demerits )
+    {
+        return params->demerits( params->context, &line, last );
+    }
+
+    // Demerits as calculated by TeX, with a line penalty of 10.
+    double ratio = fabs( line.ratio );
+    double badness = std::min( 100.0 * ratio * ratio * ratio, 10000.0 );
+    return ( 10.0 + badness ) * ( 10.0 + badness );
+}
+
+/*
+    Greedy first-fit.  Extend each line until the next break opportunity
+    would make it overflow.
+*/
+
+void fit_greedy( const ual_fit_break* breaks, size_t count, const ual_fit_params* params, std::vector< ual_line >* lines )
+{
+    size_t ilower = 0;
+    while ( ilower < count - 1 )
+    {
+        // A line always contains at least one break opportunity.
+        size_t iupper = ilower + 1;
+        ual_line line = fit_line( breaks, ilower, iupper, params, iupper == count - 1 );
+
+        // Add more text while it fits.
+        while ( iupper < count - 1 )
+        {
+            ual_line next = fit_line( breaks, ilower, iupper + 1, params, iupper + 1 == count - 1 );
+            if ( next.ratio < -1.0f )
+            {
+                break;
+            }
+            line = next;
+            iupper += 1;
+        }
+
+        lines->push_back( line );
+        ilower = iupper;
+    }
+}
+
+/*
+    Total-fit.  The best way to set the paragraph up to each break
+    opportunity is the best way to set it up to some earlier break, plus one
+    line.  Candidate earlier breaks are active in a window which advances
+    through the paragraph.  Breaks leave the window when the line starting
+    at them overflows, since lines only get longer.
+
+    Lines which overflow are only chosen if there is no alternative, so fits
+    are compared by the number of lines which overflow before demerits.
+    Overflowing lines are not scored.
+*/
+
+void fit_optimal( const ual_fit_break* breaks, size_t count, const ual_fit_params* params, std::vector< ual_fit_node >* fit_nodes, std::vector< ual_line >* lines )
+{
+    fit_nodes->resize( count );
+    ual_fit_node* nodes = fit_nodes->data();
+    nodes[ 0 ] = { 0, 0.0, 0 };
+
+    size_t window = params->window ? params->window : FIT_DEFAULT_WINDOW;
+    size_t active = 0;
+
+    for ( size_t iupper = 1; iupper < count; ++iupper )
+    {
+        bool last = iupper == count - 1;
+
+        // Bound the window.
+        if ( iupper - active > window )
+        {
+            active = iupper - window;
+        }
+
+        // Deactivate breaks where the line from them would overflow.  The
+        // immediately preceding break always remains active.
+        while ( active < iupper - 1 && fit_line( breaks, active, iupper, params, last ).ratio < -1.0f )
+        {
+            active += 1;
+        }
+
+        // Find the best line ending at this break.
+        ual_fit_node best = {};
+        for ( size_t ilower = active; ilower < iupper; ++ilower )
+        {
+            ual_line line = fit_line( breaks, ilower, iupper, params, last );
+            ual_fit_node node = nodes[ ilower ];
+            if ( line.ratio < -1.0f )
+            {
+                node.overfull += 1;
+            }
+            else
+            {
+                node.demerits += fit_demerits( line, params, last );
+            }
+
+            if ( ilower == active
+                || node.overfull < best.overfull
+                || ( node.overfull == best.overfull && node.demerits < best.demerits ) )
+            {
+                best = { node.overfull, node.demerits, (ual_index)ilower };
+            }
+        }
+
+        nodes[ iupper ] = best;
+    }
+
+    // Follow links back from the end of the paragraph.
+    size_t first = lines->size();
+    for ( size_t iupper = count - 1; iupper > 0; iupper = nodes[ iupper ].iprev )
+    {
+        size_t ilower = nodes[ iupper ].iprev;
+        lines->push_back( fit_line( breaks, ilower, iupper, params, iupper == count - 1 ) );
+    }
+    std::reverse( lines->begin() + first, lines->end() );
+}
+
+UAL_API size_t ual_fit_greedy( ual_buffer* ub, const float* advances, const ual_fit_params* params )
+{
+    ub->lines.clear();
+    if ( ub->c.empty() )
+    {
+        return 0;
+    }
+
+    fit_breaks( ub, advances );
+    fit_greedy( ub->fit_breaks.data(), ub->fit_breaks.size(), params, &ub->lines );
+    return ub->lines.size();
+}
+
+UAL_API size_t ual_fit_optimal( ual_buffer* ub, const float* advances, const ual_fit_params* params )
+{
+    ub->lines.clear();
+    if ( ub->c.empty() )
+    {
+        return 0;
+    }
+
+    fit_breaks( ub, advances );
+    fit_optimal( ub->fit_breaks.data(), ub->fit_breaks.size(), params, &ub->fit_nodes, &ub->lines );
+    return ub->lines.size();
+}
+
+/*
+    Iterator-style interface to fitted lines.
+*/
+
+UAL_API void ual_lines_begin( ual_buffer* ub )
+{
+    ub->line_index = 0;
+}
+
+UAL_API bool ual_lines_next( ual_buffer* ub, ual_line* out_line )
+{
+    assert( ub->line_index != INVALID_INDEX );
+    if ( ub->line_index >= ub->lines.size() )
+    {
+        return false;
+    }
+
+    *out_line = ub->lines[ ub->line_index++ ];
+    return true;
+}
+
+UAL_API void ual_lines_end( ual_buffer* ub )
+{
+    ub->line_index = INVALID_INDEX;
+}
@@ -10,83 +10,73 @@
 
 #include "ual_buffer.h"
 #include <assert.h>
+#include "ualyze_template.h"
+
+/*
+    Paragraph identification runs the loop of the template front end, with
+    no break machines, and a sink which adds each character to the buffer.
+*/
+
+struct paragraph_sink
+{
+    ual_buffer* ub;
+    size_t surrogate_units;
+
+    void character( size_t index, size_t next, unsigned ix, const ucdb_entry& uentry )
+    {
+        // The width of ix depends on the layout, so assign the bitfield.
+        assert( ix < IX_INVALID );
+        ual_char uchar = {};
+        uchar.ix = ix;
+        ub->c.push_back( uchar );
+        if ( next - index > 1 )
+        {
+            ub->c.push_back( { IX_INVALID, 0 } );
+            surrogate_units += 2;
+        }
+    }
+};
 
 UAL_API size_t ual_analyze_paragraph( ual_buffer* ub, const char16_t* text, size_t size )
 {
+    UAL_PROBE1( paragraph_begin, size );
+
     ub->c.clear();
+    ub->cache_record.reset();
     ub->bc_usage = BC_NONE;
+    ub->break_list_options = 0;
+    ub->cluster_index.valid = false;
+    ub->bidi_analysis.valid = false;
+    ub->bidi_classes.valid = false;
 
     // Check for empty string.
     if ( ! text || ! size )
     {
         ub->text = std::u16string_view();
+        UAL_PROBE1( paragraph_end, 0 );
         return 0;
     }
 
     // Perform analysis.
-    size_t i = 0;
-    unsigned prev = UCDB_LBREAK_XX;
-    while ( i < size )
-    {
-        // Decode character from UTF-16.
-        size_t inext = i;
-        char32_t uc = text[ inext++ ];
-
-        // Check for surrogate.
-        if ( ( uc & 0xF800 ) == 0xD800 )
-        {
-            // Get next code unit.
-            char32_t ul = inext < size ? text[ inext ] : 0;
+    paragraph_sink sink = { ub, 0 };
+    size_t i = ual::detail::paragraph_breaks< ual::detail::chars, ual::detail::library_tables >( text, size, 0, sink );
 
-            // Check for high/low surrogate pair.
-            bool have_hi_surrogate = ( uc & 0xFC00 ) == 0xD800;
-            bool have_lo_surrogate = ( ul & 0xFC00 ) == 0xDC00;
-            if ( have_hi_surrogate && have_lo_surrogate )
-            {
-                // Decode surrogate pair.
-                uc = 0x010000 + ( ( uc & 0x3FF ) << 10 ) + ( ul & 0x3FF );
-                inext += 1;
-            }
-            else
-            {
-                // Treat lone surrogates as U+FFFD REPLACEMENT CHARACTER.
-                uc = 0xFFFD;
-            }
-        }
-
-        // Look up character in unicode database.
-        unsigned ix = ucdb_lookup( uc );
-
-        // Check for line break.
-        const ucdb_entry& entry = UCDB_TABLE[ ix ];
-        unsigned curr = entry.lbreak;
-        if ( curr == UCDB_LBREAK_CM && entry.bclass == UCDB_BIDI_B )
-        {
-            curr = UCDB_LBREAK_BK;
-        }
-
-        if ( prev == UCDB_LBREAK_BK
-            || prev == UCDB_LBREAK_NL
-            || prev == UCDB_LBREAK_LF
-            || ( prev == UCDB_LBREAK_CR && curr != UCDB_LBREAK_LF ) )
-        {
-            break;
-        }
+    // Index is first character of next paragraph (or end of string).
+    ub->text = std::u16string_view( text, i );
+    assert( ub->c.size() == i );
 
-        // No line break, add character to char buffer.
-        ub->c.push_back( { (uint16_t)ix, 0 } );
-        if ( uc >= 0x010000 )
-        {
-            ub->c.push_back( { IX_INVALID, 0 } );
-        }
+    // Find cached results of analysis of the same text.
+    if ( ub->cache )
+    {
+        cache_paragraph( ub );
+    }
 
-        prev = curr;
-        i = inext;
+    if ( workload_active() )
+    {
+        workload_paragraph( i, sink.surrogate_units );
     }
 
-    // Index is first character of next paragraph (or end of string).
-    ub->text = std::u16string_view( text, i );
-    assert( ub->c.size() == i );
+    UAL_PROBE1( paragraph_end, i );
     return i;
 }
 
@@ -162,8 +162,22 @@ static unsigned lookahead( ual_buffer* ub, ual_script_brstack* stack, size_t ind
 
 UAL_API void ual_script_spans_begin( ual_buffer* ub )
 {
+    UAL_PROBE1( script_spans_begin, ub->c.size() );
+
     // Start at beginning of paragraph.
-    ub->script_analysis = { 0, UCDB_SCRIPT_LATIN, 0 };
+    ub->script_analysis = { 0, UCDB_SCRIPT_LATIN, 0, 0, INVALID_INDEX };
+
+    // Replay spans for the same text from the cache, or record new spans.
+    if ( ub->cache )
+    {
+        const uint8_t* spans = cache_section( ub, CACHE_SCRIPTS );
+        if ( spans )
+        {
+            ub->script_analysis.replay = spans - ub->cache_record->data.data();
+            return;
+        }
+        ub->script_data.clear();
+    }
 
     // Lookahead to determine script of first character.
     ual_script_brstack stack = get_brstack( ub );
@@ -189,6 +203,21 @@ UAL_API bool ual_script_spans_next( ual_buffer* ub, ual_script_span* out_span )
         return false;
     }
 
+    // Cached spans are the length and script of each span.
+    if ( ub->script_analysis.replay != INVALID_INDEX )
+    {
+        const uint8_t* data = ub->cache_record->data.data();
+        const uint8_t* p = data + ub->script_analysis.replay;
+        index += read_varint( &p );
+        curr_script = read_varint( &p );
+        ub->script_analysis.index = index;
+        ub->script_analysis.replay = p - data;
+        ub->script_analysis.spans += 1;
+        out_span->upper = index;
+        out_span->script = UCDB_SCRIPT_CODE[ curr_script ];
+        return true;
+    }
+
     // Check each character.
     unsigned char_script = curr_script;
     for ( ++index; index < length; ++index )
@@ -259,6 +288,13 @@ UAL_API bool ual_script_spans_next( ual_buffer* ub, ual_script_span* out_span )
     ub->script_analysis.index = index;
     ub->script_analysis.script = char_script;
     ub->script_analysis.sp = stack.sp;
+    ub->script_analysis.spans += 1;
+
+    if ( ub->cache )
+    {
+        push_varint( &ub->script_data, index - out_span->lower );
+        push_varint( &ub->script_data, curr_script );
+    }
 
     // Return resulting span.
     out_span->upper = index;
@@ -268,6 +304,22 @@ UAL_API bool ual_script_spans_next( ual_buffer* ub, ual_script_span* out_span )
 
 UAL_API void ual_script_spans_end( ual_buffer* ub )
 {
+    UAL_PROBE2( script_spans_end, ub->c.size(), ub->script_analysis.spans );
+
+    // Record spans if iteration reached the end of the paragraph.
+    bool complete = ub->script_analysis.index != INVALID_INDEX && ub->script_analysis.index >= ub->c.size();
+    if ( workload_active() && complete )
+    {
+        workload_script_spans( ub->script_analysis.spans );
+    }
+
+    // Cache spans which were not replayed from the cache.
+    if ( ub->cache && complete && ub->script_analysis.replay == INVALID_INDEX )
+    {
+        cache_insert( ub, CACHE_SCRIPTS, ub->script_data );
+    }
+
     ub->script_analysis.index = INVALID_INDEX;
+    ub->script_analysis.replay = INVALID_INDEX;
 }
 
@@ -0,0 +1,130 @@
+//
+//  ual_skeleton.cpp
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include "ualyze.h"
+#include <assert.h>
+#include <atomic>
+#include "ual_buffer.h"
+
+/*
+    Break positions are stored as varints - the distance from the previous
+    break, then the length of the trailing space run.  The width of the text
+    since the previous break and the width of the trailing spaces are stored
+    separately.  Running totals are rebuilt at query time, in the buffer
+    passed to the query, so that queries never write to the skeleton.
+*/
+
+struct ual_skeleton
+{
+    std::atomic< intptr_t > refcount;
+    size_t length;
+    size_t count;
+    std::vector< uint8_t > positions;   // varint index delta, then index - spaces.
+    std::vector< float > widths;        // text width, then space width.
+};
+
+UAL_API ual_skeleton* ual_skeleton_create( ual_buffer* ub, const float* advances )
+{
+    ual_skeleton* sk = new ual_skeleton();
+    sk->refcount = 1;
+    sk->length = ub->c.size();
+    sk->count = 0;
+
+    // Collect breaks from the buffer.  The first break is the start of text.
+    if ( ! ub->c.empty() )
+    {
+        fit_breaks( ub, advances );
+        sk->count = ub->fit_breaks.size() - 1;
+        sk->widths.reserve( sk->count * 2 );
+        for ( size_t i = 0; i < sk->count; ++i )
+        {
+            const ual_fit_break& prev = ub->fit_breaks[ i ];
+            const ual_fit_break& b = ub->fit_breaks[ i + 1 ];
+            push_varint( &sk->positions, b.index - prev.index );
+            push_varint( &sk->positions, b.index - b.spaces );
+            sk->widths.push_back( (float)( b.width - prev.total ) );
+            sk->widths.push_back( (float)( b.total - b.width ) );
+        }
+        sk->positions.shrink_to_fit();
+    }
+
+    return sk;
+}
+
+UAL_API ual_skeleton* ual_skeleton_retain( ual_skeleton* sk )
+{
+    sk->refcount.fetch_add( 1, std::memory_order_relaxed );
+    return sk;
+}
+
+UAL_API void ual_skeleton_release( ual_skeleton* sk )
+{
+    if ( sk && sk->refcount.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+    {
+        delete sk;
+    }
+}
+
+UAL_API size_t ual_skeleton_size( const ual_skeleton* sk )
+{
+    return sk->length;
+}
+
+/*
+    Queries.
+*/
+
+static void skeleton_breaks( const ual_skeleton* sk, std::vector< ual_fit_break >* breaks )
+{
+    breaks->resize( sk->count + 1 );
+    ual_fit_break* b = breaks->data();
+    b[ 0 ] = { 0, 0, 0.0, 0.0, 0.0 };
+
+    const uint8_t* p = sk->positions.data();
+    const float* w = sk->widths.data();
+    size_t index = 0;
+    double total = 0.0;
+    double glue = 0.0;
+    for ( size_t i = 0; i < sk->count; ++i )
+    {
+        index += read_varint( &p );
+        size_t spaces = index - read_varint( &p );
+        double width = total + w[ i * 2 ];
+        total = width + w[ i * 2 + 1 ];
+        glue += w[ i * 2 + 1 ];
+        b[ i + 1 ] = { (ual_index)index, (ual_index)spaces, width, total, glue };
+    }
+}
+
+UAL_API size_t ual_skeleton_greedy( const ual_skeleton* sk, ual_buffer* ub, const ual_fit_params* params )
+{
+    ub->lines.clear();
+    if ( ! sk->count )
+    {
+        return 0;
+    }
+
+    skeleton_breaks( sk, &ub->fit_breaks );
+    fit_greedy( ub->fit_breaks.data(), ub->fit_breaks.size(), params, &ub->lines );
+    return ub->lines.size();
+}
+
+UAL_API size_t ual_skeleton_optimal( const ual_skeleton* sk, ual_buffer* ub, const ual_fit_params* params )
+{
+    ub->lines.clear();
+    if ( ! sk->count )
+    {
+        return 0;
+    }
+
+    skeleton_breaks( sk, &ub->fit_breaks );
+    fit_optimal( ub->fit_breaks.data(), ub->fit_breaks.size(), params, &ub->fit_nodes, &ub->lines );
+    return ub->lines.size();
+}
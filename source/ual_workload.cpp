@@ -0,0 +1,174 @@
+//
+//  ual_workload.cpp
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include "ual_buffer.h"
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <algorithm>
+
+/*
+    Global workload statistics.  Each counter is a relaxed atomic, so
+    recording never blocks analysis on other threads.
+*/
+
+static_assert( UAL_COMPLEXITY_ALL_LEFT == BIDI_ALL_LEFT );
+static_assert( UAL_COMPLEXITY_ALL_RIGHT == BIDI_ALL_RIGHT );
+static_assert( UAL_COMPLEXITY_STRONG == BIDI_STRONG );
+static_assert( UAL_COMPLEXITY_SOLITARY == BIDI_SOLITARY );
+static_assert( UAL_COMPLEXITY_ISOLATES == BIDI_ISOLATES );
+static_assert( UAL_COMPLEXITY_EXPLICIT == BIDI_EXPLICIT );
+
+struct ual_workload_counters
+{
+    std::atomic< uint64_t > paragraphs;
+    std::atomic< uint64_t > units;
+    std::atomic< uint64_t > surrogate_units;
+    std::atomic< uint64_t > complexity[ UAL_COMPLEXITY_COUNT ];
+    std::atomic< uint64_t > length[ UAL_WORKLOAD_LENGTH_BUCKETS ];
+    std::atomic< uint64_t > surrogates[ UAL_WORKLOAD_SURROGATE_BUCKETS ];
+    std::atomic< uint64_t > script_spans[ UAL_WORKLOAD_SPAN_BUCKETS ];
+};
+
+static_assert( sizeof( ual_workload_counters ) == sizeof( ual_workload ) );
+
+std::atomic< bool > workload_enabled( false );
+static ual_workload_counters workload_counters;
+
+static void count( std::atomic< uint64_t >* counter, uint64_t value )
+{
+    counter->fetch_add( value, std::memory_order_relaxed );
+}
+
+static unsigned bit_length( size_t value, unsigned bucket_count )
+{
+    unsigned bits = 0;
+    while ( value )
+    {
+        bits += 1;
+        value >>= 1;
+    }
+    return std::min( bits, bucket_count - 1 );
+}
+
+void workload_paragraph( size_t length, size_t surrogate_units )
+{
+    ual_workload_counters* w = &workload_counters;
+    count( &w->paragraphs, 1 );
+    count( &w->units, length );
+    count( &w->surrogate_units, surrogate_units );
+    count( &w->length[ bit_length( length, UAL_WORKLOAD_LENGTH_BUCKETS ) ], 1 );
+
+    // Fraction of units in surrogate pairs, in eighths rounded up.
+    size_t eighths = length ? ( surrogate_units * 8 + length - 1 ) / length : 0;
+    count( &w->surrogates[ eighths ], 1 );
+}
+
+void workload_complexity( unsigned complexity )
+{
+    assert( complexity < UAL_COMPLEXITY_COUNT );
+    count( &workload_counters.complexity[ complexity ], 1 );
+}
+
+void workload_script_spans( size_t spans )
+{
+    count( &workload_counters.script_spans[ bit_length( spans, UAL_WORKLOAD_SPAN_BUCKETS ) ], 1 );
+}
+
+UAL_API void ual_workload_enable( bool enable )
+{
+    workload_enabled.store( enable, std::memory_order_relaxed );
+}
+
+UAL_API void ual_workload_reset()
+{
+    std::atomic< uint64_t >* counters = (std::atomic< uint64_t >*)&workload_counters;
+    for ( size_t i = 0; i < sizeof( ual_workload ) / sizeof( uint64_t ); ++i )
+    {
+        counters[ i ].store( 0, std::memory_order_relaxed );
+    }
+}
+
+UAL_API void ual_workload_snapshot( ual_workload* out_workload )
+{
+    const std::atomic< uint64_t >* counters = (const std::atomic< uint64_t >*)&workload_counters;
+    uint64_t* values = (uint64_t*)out_workload;
+    for ( size_t i = 0; i < sizeof( ual_workload ) / sizeof( uint64_t ); ++i )
+    {
+        values[ i ] = counters[ i ].load( std::memory_order_relaxed );
+    }
+}
+
+/*
+    Text dump, one line per counter or non-empty histogram bucket.
+*/
+
+struct ual_dump
+{
+    char* buffer;
+    size_t size;
+    size_t length;
+};
+
+static void dump( ual_dump* d, const char* format, ... )
+{
+    va_list args;
+    va_start( args, format );
+    size_t remaining = d->length < d->size ? d->size - d->length : 0;
+    int n = vsnprintf( d->buffer ? d->buffer + std::min( d->length, d->size ) : nullptr, remaining, format, args );
+    va_end( args );
+    d->length += n > 0 ? n : 0;
+}
+
+static void dump_histogram( ual_dump* d, const char* name, const uint64_t* buckets, size_t count, bool powers )
+{
+    for ( size_t i = 0; i < count; ++i )
+    {
+        if ( ! buckets[ i ] )
+        {
+            continue;
+        }
+
+        if ( powers )
+        {
+            size_t lower = i ? (size_t)1 << ( i - 1 ) : 0;
+            dump( d, "%s[%zu..] %llu\n", name, lower, (unsigned long long)buckets[ i ] );
+        }
+        else
+        {
+            dump( d, "%s[%zu/8] %llu\n", name, i, (unsigned long long)buckets[ i ] );
+        }
+    }
+}
+
+UAL_API size_t ual_workload_dump( char* buffer, size_t size )
+{
+    static const char* const COMPLEXITY_NAMES[ UAL_COMPLEXITY_COUNT ] =
+    {
+        "all_left", "all_right", "strong", "solitary", "isolates", "explicit"
+    };
+
+    ual_workload w;
+    ual_workload_snapshot( &w );
+
+    ual_dump d = { buffer, size, 0 };
+
+    dump( &d, "paragraphs %llu\n", (unsigned long long)w.paragraphs );
+    dump( &d, "units %llu\n", (unsigned long long)w.units );
+    dump( &d, "surrogate_units %llu\n", (unsigned long long)w.surrogate_units );
+    for ( size_t i = 0; i < UAL_COMPLEXITY_COUNT; ++i )
+    {
+        dump( &d, "complexity.%s %llu\n", COMPLEXITY_NAMES[ i ], (unsigned long long)w.complexity[ i ] );
+    }
+    dump_histogram( &d, "length", w.length, UAL_WORKLOAD_LENGTH_BUCKETS, true );
+    dump_histogram( &d, "surrogates", w.surrogates, UAL_WORKLOAD_SURROGATE_BUCKETS, false );
+    dump_histogram( &d, "script_spans", w.script_spans, UAL_WORKLOAD_SPAN_BUCKETS, true );
+    return d.length;
+}
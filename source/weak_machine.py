@@ -0,0 +1,412 @@
+#!/usr/bin/env python3
+#
+#  weak_machine.py
+#
+#  Created by Edmund Kapusniak on 19/10/2026.
+#  Copyright © 2026 Edmund Kapusniak.
+#
+#  Licensed under the ISC License. See LICENSE file in the project root for
+#  full license information.
+#
+
+#
+#  Parse a .rules file describing the resolution of weak bidi types, and
+#  construct a state machine which implements it.  The file contains:
+#
+#   NAME
+#   NAME = VALUE
+#       A class.  Classes are numbered in order, unless a value is given.
+#
+#   skip A B ...
+#       Characters of these classes are ignored and do not change the state.
+#
+#   var NAME VALUE
+#       A variable, with its initial value.  A value of sos is the class at
+#       the start of the level run.
+#
+#   point NAME
+#   span NAME
+#       Saved positions, which are marked by one character and later patched
+#       with a new class.  Patching a span changes the class of all characters
+#       which are not skipped, from the marked character up to (but not
+#       including) the current character.  Marking a point always moves it,
+#       but marking a span which is already marked does nothing.
+#
+#   result NAME
+#       The value of this variable at the end of the level run is reported.
+#
+#   GROUP :
+#       Starts a group of rules.  For each character, the groups are applied
+#       in order.  Within each group, the first rule that matches applies.
+#       Rules in the group named end are applied at the end of the run.
+#
+#   CLASSES CONDITIONS -> ACTIONS
+#       CLASSES is a comma-separated list of classes, or '.' to match any
+#       class.  Each condition is one of:
+#           var=A,B     variable has one of the values.
+#           var!=A,B    variable does not have any of the values.
+#           +pos        saved position is marked.
+#           -pos        saved position is not marked.
+#       Each action is one of:
+#           A           change class of current character to A.
+#           $var        change class of current character to value of var.
+#           var=A       assign A to variable.
+#           var=$       assign class of current character to variable.
+#           mark pos    mark saved position at current character.
+#           patch pos A change class of characters at saved position to A.
+#           stop        do not apply any further groups to this character.
+#
+#  The state of the machine is the values of all variables and which saved
+#  positions are marked.
+#
+
+import sys
+import os
+
+class Rules:
+
+    def __init__( self ):
+        self.classes = {}
+        self.skip = []
+        self.vars = []
+        self.points = []
+        self.spans = []
+        self.result = None
+        self.groups = []
+        self.end = []
+
+def parse_values( text ):
+    return text.split( ',' )
+
+def parse_rules( path ):
+
+    r = Rules()
+    group = None
+    value = 0
+
+    with open( path, 'r' ) as f:
+        for line in f:
+
+            # Get rid of comment.
+            comment_index = line.find( '--' )
+            if comment_index != -1:
+                line = line[:comment_index]
+
+            tokens = line.split()
+            if len( tokens ) == 0:
+                continue
+
+            if tokens[ 0 ] == 'skip':
+                r.skip += tokens[ 1: ]
+            elif tokens[ 0 ] == 'var':
+                r.vars.append( ( tokens[ 1 ], tokens[ 2 ] ) )
+            elif tokens[ 0 ] == 'point':
+                r.points.append( tokens[ 1 ] )
+            elif tokens[ 0 ] == 'span':
+                r.spans.append( tokens[ 1 ] )
+            elif tokens[ 0 ] == 'result':
+                r.result = tokens[ 1 ]
+            elif tokens[ -1 ] == ':':
+                group = []
+                if tokens[ 0 ] == 'end':
+                    r.end = group
+                else:
+                    r.groups.append( group )
+            elif '->' in tokens:
+                arrow = tokens.index( '->' )
+                match = tokens[ 0 ]
+                conditions = tokens[ 1 : arrow ]
+                actions = tokens[ arrow + 1 : ]
+                group.append( ( match, conditions, actions ) )
+            elif len( tokens ) == 3 and tokens[ 1 ] == '=':
+                value = int( tokens[ 2 ] )
+                r.classes[ tokens[ 0 ] ] = value
+                value += 1
+            elif len( tokens ) == 1:
+                r.classes[ tokens[ 0 ] ] = value
+                value += 1
+            else:
+                print( "invalid line:", line.strip() )
+                sys.exit( 1 )
+
+    return r
+
+#
+#  Apply the rules to a single character.  Returns the new class of the
+#  character, a dictionary of actions on saved positions, and the new state.
+#
+
+def check( r, state, cls, conditions ):
+
+    values, marked = state
+    for condition in conditions:
+        if condition[ 0 ] == '+' or condition[ 0 ] == '-':
+            if ( condition[ 1: ] in marked ) != ( condition[ 0 ] == '+' ):
+                return False
+        elif '!=' in condition:
+            var, options = condition.split( '!=' )
+            if values[ var ] in parse_values( options ):
+                return False
+        else:
+            var, options = condition.split( '=' )
+            if values[ var ] not in parse_values( options ):
+                return False
+    return True
+
+def apply_group( r, group, state, cls, ops ):
+
+    values, marked = state
+    for match, conditions, actions in group:
+        if match != '.' and cls not in parse_values( match ):
+            continue
+        if not check( r, state, cls, conditions ):
+            continue
+
+        stop = False
+        i = 0
+        while i < len( actions ):
+            action = actions[ i ]
+            if action == 'stop':
+                stop = True
+            elif action == 'mark':
+                pos = actions[ i + 1 ]
+                if pos in r.points or pos not in marked:
+                    marked.add( pos )
+                    ops[ pos ] = ( 'mark', None )
+                i += 1
+            elif action == 'patch':
+                pos = actions[ i + 1 ]
+                if pos in marked:
+                    marked.discard( pos )
+                    assert pos not in ops
+                    ops[ pos ] = ( 'patch', actions[ i + 2 ] )
+                i += 2
+            elif '=' in action:
+                var, value = action.split( '=' )
+                if value == '$':
+                    value = cls
+                elif value.startswith( '$' ):
+                    value = values[ value[ 1: ] ]
+                values[ var ] = value
+            elif action.startswith( '$' ):
+                cls = values[ action[ 1: ] ]
+            else:
+                cls = action
+            i += 1
+
+        return cls, stop
+
+    return cls, False
+
+def step( r, state, cls ):
+
+    values = dict( state[ 0 ] )
+    marked = set( state[ 1 ] )
+    ops = {}
+
+    if cls not in r.skip:
+        for group in r.groups:
+            cls, stop = apply_group( r, group, ( values, marked ), cls, ops )
+            if stop:
+                break
+
+    return cls, ops, freeze( values, marked )
+
+def step_end( r, state ):
+
+    values = dict( state[ 0 ] )
+    marked = set( state[ 1 ] )
+    ops = {}
+    apply_group( r, r.end, ( values, marked ), None, ops )
+    return ops
+
+def freeze( values, marked ):
+    return ( tuple( sorted( values.items() ) ), tuple( sorted( marked ) ) )
+
+#
+#  Build machine.
+#
+
+def build_machine( r ):
+
+    classes = sorted( r.classes, key=lambda c : r.classes[ c ] )
+    starts = [ 'L', 'R', 'AL' ]
+
+    # Explore reachable states.
+    index = {}
+    build_list = []
+    for sos in starts:
+        values = { var : sos if init == 'sos' else init for var, init in r.vars }
+        state = freeze( values, set() )
+        if state not in index:
+            index[ state ] = len( build_list )
+            build_list.append( state )
+
+    rows = []
+    while len( rows ) < len( build_list ):
+        state = build_list[ len( rows ) ]
+        row = []
+        for cls in classes:
+            out, ops, next_state = step( r, state, cls )
+            if next_state not in index:
+                index[ next_state ] = len( build_list )
+                build_list.append( next_state )
+            row.append( ( out, tuple( sorted( ops.items() ) ), index[ next_state ] ) )
+        rows.append( row )
+
+    # Observable behaviour of each state, apart from its transitions.
+    def signature( state ):
+        values = dict( state[ 0 ] )
+        end = tuple( sorted( step_end( r, state ).items() ) )
+        outputs = tuple( ( out, ops ) for out, ops, next_state in rows[ index[ state ] ] )
+        return ( values[ r.result ], end, outputs )
+
+    # Minimize by partition refinement.
+    partition = {}
+    block = []
+    for state in build_list:
+        key = signature( state )
+        if key not in partition:
+            partition[ key ] = len( partition )
+        block.append( partition[ key ] )
+
+    while True:
+        partition = {}
+        refined = []
+        for i in range( len( build_list ) ):
+            key = ( block[ i ], tuple( block[ next_state ] for out, ops, next_state in rows[ i ] ) )
+            if key not in partition:
+                partition[ key ] = len( partition )
+            refined.append( partition[ key ] )
+        if len( partition ) == len( set( block ) ):
+            block = refined
+            break
+        block = refined
+
+    # Renumber so that start states come first, in order.
+    order = []
+    for i in range( len( build_list ) ):
+        if block[ i ] not in order:
+            order.append( block[ i ] )
+    renumber = { b : order.index( b ) for b in order }
+
+    count = len( order )
+    table = [ None ] * count
+    results = [ None ] * count
+    ends = [ None ] * count
+    for i in range( len( build_list ) ):
+        s = renumber[ block[ i ] ]
+        if table[ s ] is None:
+            table[ s ] = [ ( out, ops, renumber[ block[ next_state ] ] ) for out, ops, next_state in rows[ i ] ]
+            results[ s ] = dict( build_list[ i ][ 0 ] )[ r.result ]
+            ends[ s ] = tuple( sorted( step_end( r, build_list[ i ] ).items() ) )
+
+    start = [ renumber[ block[ index[ freeze( { var : sos if init == 'sos' else init for var, init in r.vars }, set() ) ] ] ] for sos in starts ]
+
+    # Merge classes which behave identically in every state.
+    columns = {}
+    class_column = {}
+    for j in range( len( classes ) ):
+        column = tuple( row[ j ] for row in table )
+        if column not in columns:
+            columns[ column ] = len( columns )
+        class_column[ classes[ j ] ] = columns[ column ]
+
+    merged = []
+    for row in table:
+        mrow = [ None ] * len( columns )
+        for j in range( len( classes ) ):
+            mrow[ class_column[ classes[ j ] ] ] = row[ j ]
+        merged.append( mrow )
+
+    return merged, start, results, ends, class_column
+
+#
+#  Output.
+#
+
+def write_machine( path, name, r, table, start, results, ends, class_column ):
+
+    # Transition layout.
+    points = r.points
+    spans = r.spans
+    assert len( points ) <= 1 and len( spans ) <= 1
+
+    CLASS_MASK      = 0x1F
+    POINT_SHIFT     = 5
+    SPAN_SHIFT      = 10
+    PATCH_POINT     = 1 << 15
+    MARK_POINT      = 1 << 16
+    PATCH_SPAN      = 1 << 17
+    MARK_SPAN       = 1 << 18
+    STATE_SHIFT     = 19
+
+    # States are stored as the offset of their row in the table.
+    column_count = len( table[ 0 ] )
+
+    def encode( out, ops, next_state ):
+        value = r.classes[ out ] | ( next_state * column_count ) << STATE_SHIFT
+        for pos, ( op, cls ) in ops:
+            if pos in points:
+                if op == 'patch':
+                    value |= PATCH_POINT | r.classes[ cls ] << POINT_SHIFT
+                else:
+                    value |= MARK_POINT
+            else:
+                if op == 'patch':
+                    value |= PATCH_SPAN | r.classes[ cls ] << SPAN_SHIFT
+                else:
+                    value |= MARK_SPAN
+        return value
+
+    prefix = name.upper()
+    state_count = len( table )
+    assert ( state_count * column_count ) << STATE_SHIFT < 1 << 32
+
+    with open( path, 'w' ) as f:
+        print( f"const unsigned { prefix }_CLASS_MASK = 0x{ CLASS_MASK :02X};", file=f )
+        print( f"const unsigned { prefix }_POINT_SHIFT = { POINT_SHIFT };", file=f )
+        print( f"const unsigned { prefix }_SPAN_SHIFT = { SPAN_SHIFT };", file=f )
+        print( f"const unsigned { prefix }_PATCH_POINT = 0x{ PATCH_POINT :X};", file=f )
+        print( f"const unsigned { prefix }_MARK_POINT = 0x{ MARK_POINT :X};", file=f )
+        print( f"const unsigned { prefix }_PATCH_SPAN = 0x{ PATCH_SPAN :X};", file=f )
+        print( f"const unsigned { prefix }_MARK_SPAN = 0x{ MARK_SPAN :X};", file=f )
+        print( f"const unsigned { prefix }_STATE_SHIFT = { STATE_SHIFT };\n", file=f )
+
+        # Map from class value to column.
+        column = [ 0 ] * 32
+        for cls, value in r.classes.items():
+            column[ value ] = class_column[ cls ]
+        print( f"static const uint8_t { prefix }_COLUMN[ 32 ] =\n{{", file=f )
+        for i in range( 0, 32, 16 ):
+            print( "    " + " ".join( f"{ c }," for c in column[ i : i + 16 ] ), file=f )
+        print( "};\n", file=f )
+
+        # Start state for each sos class.
+        print( f"static const uint16_t { prefix }_START[ 3 ] = {{ { ', '.join( str( s * column_count ) for s in start ) } }};\n", file=f )
+
+        # Result and end-of-run actions for each state.
+        print( f"static const uint8_t { prefix }_RESULT[ { state_count } ] =\n{{", file=f )
+        for i in range( 0, state_count, 16 ):
+            print( "    " + " ".join( f"{ r.classes[ c ] }," for c in results[ i : i + 16 ] ), file=f )
+        print( "};\n", file=f )
+
+        print( f"static const uint32_t { prefix }_END[ { state_count } ] =\n{{", file=f )
+        for i in range( 0, state_count, 8 ):
+            print( "    " + " ".join( f"0x{ encode( 'L', ops, 0 ) :08X}," for ops in ends[ i : i + 8 ] ), file=f )
+        print( "};\n", file=f )
+
+        # Transitions, indexed by row offset plus column.
+        print( f"const unsigned { prefix }_COLUMNS = { column_count };\n", file=f )
+        print( f"static const uint32_t { prefix }[ { state_count * column_count } ] =\n{{", file=f )
+        for i in range( state_count ):
+            print( f"    /* STATE { i } */", file=f )
+            for j in range( 0, column_count, 6 ):
+                print( "    " + " ".join( f"0x{ encode( *t ) :08X}," for t in table[ i ][ j : j + 6 ] ), file=f )
+        print( "};\n", file=f )
+
+
+r = parse_rules( sys.argv[ 1 ] )
+table, start, results, ends, class_column = build_machine( r )
+name = os.path.splitext( os.path.basename( sys.argv[ 1 ] ) )[ 0 ]
+write_machine( sys.argv[ 2 ], name, r, table, start, results, ends, class_column )
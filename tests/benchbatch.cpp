@@ -0,0 +1,128 @@
+//
+//  benchbatch.cpp
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <ualyze.h>
+
+/*
+    Compare batch bidi analysis of many short strings against analyzing each
+    string with the paragraph and bidi run interfaces.
+*/
+
+static const char16_t* const WORDS[] =
+{
+    u"hello", u"world", u"your", u"order", u"has", u"shipped", u"today",
+    u"مرحبا", u"بالعالم", u"طلبك", u"تم", u"شحن", u"اليوم",
+    u"#4521", u"12:30", u"٤٥٢١",
+};
+
+int main( int argc, char* argv[] )
+{
+    size_t count = argc > 1 ? atoi( argv[ 1 ] ) : 100000;
+
+    // Build strings of 20 to 80 units.  Most strings use one script.
+    std::vector< std::u16string > texts;
+    size_t units = 0;
+    unsigned seed = 1;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        seed = seed * 1103515245 + 12345;
+        size_t target = 20 + ( seed >> 16 ) % 61;
+        unsigned mode = ( seed >> 8 ) % 4;
+
+        std::u16string text;
+        while ( text.size() < target )
+        {
+            seed = seed * 1103515245 + 12345;
+            size_t word = ( seed >> 16 ) % 16;
+            if ( mode == 0 )
+                word = word % 7;
+            else if ( mode == 1 )
+                word = 7 + word % 6;
+            if ( text.size() )
+                text.push_back( u' ' );
+            text.append( WORDS[ word ] );
+        }
+
+        units += text.size();
+        texts.push_back( std::move( text ) );
+    }
+
+    std::vector< ual_bidi_batch_string > strings;
+    for ( const std::u16string& text : texts )
+    {
+        strings.push_back( { text.data(), text.size() } );
+    }
+
+    printf( "strings: %zu, %zu units\n", strings.size(), units );
+
+    ual_buffer* ub = ual_buffer_create();
+    std::vector< ual_bidi_batch_result > results( strings.size() );
+    std::vector< ual_bidi_run > runs( units );
+
+    // Report the best of several runs.
+    const int ITERATIONS = 20;
+    double loop_ms = INFINITY;
+    double batch_ms = INFINITY;
+    size_t loop_runs = 0;
+    size_t batch_runs = 0;
+    for ( int i = 0; i < ITERATIONS; ++i )
+    {
+        // Analyze each string in turn.
+        auto start = std::chrono::steady_clock::now();
+        loop_runs = 0;
+        for ( const ual_bidi_batch_string& string : strings )
+        {
+            size_t lower = 0;
+            while ( lower < string.size )
+            {
+                size_t length = ual_analyze_paragraph( ub, string.text + lower, string.size - lower );
+                ual_analyze_bidi( ub, UAL_FROM_TEXT );
+
+                ual_bidi_run run;
+                ual_bidi_runs_begin( ub );
+                while ( ual_bidi_runs_next( ub, &run ) )
+                {
+                    runs[ loop_runs++ ] = { lower + run.lower, lower + run.upper, run.level };
+                }
+                ual_bidi_runs_end( ub );
+
+                lower += length;
+            }
+        }
+        auto finish = std::chrono::steady_clock::now();
+        loop_ms = std::min( loop_ms, std::chrono::duration< double, std::milli >( finish - start ).count() );
+
+        // Analyze all strings in a batch.
+        start = std::chrono::steady_clock::now();
+        size_t analyzed = ual_analyze_bidi_batch( ub, strings.data(), strings.size(), UAL_FROM_TEXT, results.data(), runs.data(), runs.size() );
+        finish = std::chrono::steady_clock::now();
+        batch_ms = std::min( batch_ms, std::chrono::duration< double, std::milli >( finish - start ).count() );
+
+        if ( analyzed != strings.size() )
+        {
+            fprintf( stderr, "batch stopped at %zu strings\n", analyzed );
+            return EXIT_FAILURE;
+        }
+        batch_runs = results.back().run_index + results.back().run_count;
+    }
+
+    printf( "loop: %.3f ms, %.2f ns/unit, %.1f M units/s, %zu runs\n", loop_ms, loop_ms * 1e6 / units, units / loop_ms / 1e3, loop_runs );
+    printf( "batch: %.3f ms, %.2f ns/unit, %.1f M units/s, %zu runs\n", batch_ms, batch_ms * 1e6 / units, units / batch_ms / 1e3, batch_runs );
+
+    ual_buffer_release( ub );
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,107 @@
+//
+//  benchbidi.cpp
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <ualyze.h>
+
+/*
+    Measure the throughput of bidi analysis on mixed Arabic and number text.
+*/
+
+static const char16_t* const SAMPLES[] =
+{
+    u"مرحبا بالعالم ",
+    u"السعر ١٢٫٥٠ دينار، ",
+    u"رقم 12,345.67 ",
+    u"+1-555-0100 ",
+    u"$100 - 20% ",
+    u"٪٣٠ ",
+    u"(١٩٩٩/٢٠٢٠) ",
+    u"abc 1.2.3 ",
+};
+
+int main( int argc, char* argv[] )
+{
+    size_t size = argc > 1 ? atoi( argv[ 1 ] ) : 256 * 1024;
+
+    // Build paragraph from samples.
+    std::u16string text;
+    unsigned seed = 1;
+    while ( text.size() < size )
+    {
+        seed = seed * 1103515245 + 12345;
+        text.append( SAMPLES[ ( seed >> 16 ) % ( sizeof( SAMPLES ) / sizeof( SAMPLES[ 0 ] ) ) ] );
+    }
+
+    ual_buffer* ub = ual_buffer_create();
+    size_t length = ual_analyze_paragraph( ub, text.data(), text.size() );
+
+#if defined( UAL_WIDE )
+    printf( "layout: wide\n" );
+#else
+    printf( "layout: narrow\n" );
+#endif
+    printf( "paragraph: %zu units\n", length );
+
+    // Report the best of several runs.
+    const int ITERATIONS = 50;
+    double ms = INFINITY;
+    for ( int i = 0; i < ITERATIONS; ++i )
+    {
+        auto start = std::chrono::steady_clock::now();
+        ual_analyze_bidi( ub, UAL_FROM_TEXT );
+        auto finish = std::chrono::steady_clock::now();
+        ms = std::min( ms, std::chrono::duration< double, std::milli >( finish - start ).count() );
+    }
+
+    size_t runs = 0;
+    ual_bidi_run run;
+    ual_bidi_runs_begin( ub );
+    while ( ual_bidi_runs_next( ub, &run ) )
+    {
+        runs += 1;
+    }
+    ual_bidi_runs_end( ub );
+
+    printf( "bidi: %.3f ms, %.2f ns/unit, %zu runs\n", ms, ms * 1e6 / length, runs );
+
+    // Compare writing levels directly with reconstructing them from runs.
+    std::vector< uint8_t > levels( length );
+    double levels_ms = INFINITY;
+    double runs_ms = INFINITY;
+    for ( int i = 0; i < ITERATIONS; ++i )
+    {
+        auto start = std::chrono::steady_clock::now();
+        ual_bidi_levels( ub, levels.data() );
+        auto finish = std::chrono::steady_clock::now();
+        levels_ms = std::min( levels_ms, std::chrono::duration< double, std::milli >( finish - start ).count() );
+
+        start = std::chrono::steady_clock::now();
+        ual_bidi_runs_begin( ub );
+        while ( ual_bidi_runs_next( ub, &run ) )
+        {
+            std::fill( levels.begin() + run.lower, levels.begin() + run.upper, (uint8_t)run.level );
+        }
+        ual_bidi_runs_end( ub );
+        finish = std::chrono::steady_clock::now();
+        runs_ms = std::min( runs_ms, std::chrono::duration< double, std::milli >( finish - start ).count() );
+    }
+
+    printf( "levels: %.2f ns/unit, from runs: %.2f ns/unit\n", levels_ms * 1e6 / length, runs_ms * 1e6 / length );
+
+    ual_buffer_release( ub );
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,76 @@
+//
+//  benchbrackets.cpp
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <ualyze.h>
+
+/*
+    Stress bracket pair resolution in paragraphs with many isolates, like chat
+    messages with inline mentions.  Each unit contains a bracket pair which is
+    resolved to the opposite direction only after an inner pair has guessed
+    the embedding direction, and so rewinds across isolates.  Time per unit
+    should not grow with the size of the paragraph.
+*/
+
+static const char16_t UNIT[] = u"א (⁦@name⁩ (ב) ⁦@other⁩) ";
+
+int main( int argc, char* argv[] )
+{
+    size_t max_size = argc > 1 ? atoi( argv[ 1 ] ) : 256 * 1024;
+
+#if defined( UAL_WIDE )
+    printf( "layout: wide\n" );
+#else
+    printf( "layout: narrow\n" );
+#endif
+
+    ual_buffer* ub = ual_buffer_create();
+    for ( size_t size = 4096; size <= max_size; size *= 4 )
+    {
+        // Build left-to-right paragraph from units.
+        std::u16string text = u"a ";
+        while ( text.size() < size )
+        {
+            text.append( UNIT );
+        }
+
+        size_t length = ual_analyze_paragraph( ub, text.data(), text.size() );
+
+        // Report the best of several runs.
+        const int ITERATIONS = 20;
+        double ms = INFINITY;
+        for ( int i = 0; i < ITERATIONS; ++i )
+        {
+            auto start = std::chrono::steady_clock::now();
+            ual_analyze_bidi( ub, UAL_FROM_TEXT );
+            auto finish = std::chrono::steady_clock::now();
+            ms = std::min( ms, std::chrono::duration< double, std::milli >( finish - start ).count() );
+        }
+
+        size_t runs = 0;
+        ual_bidi_run run;
+        ual_bidi_runs_begin( ub );
+        while ( ual_bidi_runs_next( ub, &run ) )
+        {
+            runs += 1;
+        }
+        ual_bidi_runs_end( ub );
+
+        printf( "%8zu units: %9.3f ms, %7.2f ns/unit, %zu runs\n", length, ms, ms * 1e6 / length, runs );
+    }
+
+    ual_buffer_release( ub );
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+//
+//  benchbreak.cpp
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <ualyze.h>
+
+/*
+    Measure the throughput of break analysis on mixed text.  Build with and
+    without the break_product option to compare the two state machines.
+*/
+
+static const char16_t* const SAMPLES[] =
+{
+    u"The quick brown fox jumps over the lazy dog. ",
+    u"Prices rose by 12.5% to $1,234.56 (in 2019) - see §4.2. ",
+    u"日本語の文章。これはテストです。",
+    u"مرحبا بالعالم ",
+    u"\U0001F468‍\U0001F469‍\U0001F467 \U0001F44D\U0001F3FD \U0001F1EC\U0001F1E7 ",
+    u"é ä क्ष 한국어 ",
+    u"1 2 3 -4 +5 (6) [7] 8.9 10,11 ",
+};
+
+int main( int argc, char* argv[] )
+{
+    size_t size = argc > 1 ? atoi( argv[ 1 ] ) : 1024 * 1024;
+
+    // Build paragraph from samples.
+    std::u16string text;
+    unsigned seed = 1;
+    while ( text.size() < size )
+    {
+        seed = seed * 1103515245 + 12345;
+        text.append( SAMPLES[ ( seed >> 16 ) % ( sizeof( SAMPLES ) / sizeof( SAMPLES[ 0 ] ) ) ] );
+    }
+
+    ual_buffer* ub = ual_buffer_create();
+    size_t length = ual_analyze_paragraph( ub, text.data(), text.size() );
+
+#if defined( UAL_BREAK_PRODUCT )
+    printf( "machine: product\n" );
+#else
+    printf( "machine: separate\n" );
+#endif
+    printf( "paragraph: %zu units\n", length );
+
+    // Report the best of several runs.
+    const int ITERATIONS = 50;
+    double ms = INFINITY;
+    for ( int i = 0; i < ITERATIONS; ++i )
+    {
+        auto start = std::chrono::steady_clock::now();
+        ual_analyze_breaks( ub );
+        auto finish = std::chrono::steady_clock::now();
+        ms = std::min( ms, std::chrono::duration< double, std::milli >( finish - start ).count() );
+    }
+
+    // Count breaks, so results can be compared between builds.
+    size_t clusters = 0;
+    size_t lines = 0;
+    size_t spaces = 0;
+    const ual_char* c = ual_buffer_chars( ub );
+    for ( size_t i = 0; i < length; ++i )
+    {
+        clusters += ( c[ i ].bc & UAL_BREAK_CLUSTER ) != 0;
+        lines += ( c[ i ].bc & UAL_BREAK_LINE ) != 0;
+        spaces += ( c[ i ].bc & UAL_BREAK_SPACES ) != 0;
+    }
+
+    printf( "breaks: %.3f ms, %.2f ns/unit, %.0f MB/s\n", ms, ms * 1e6 / length, length * 2 / ( ms * 1e3 ) );
+    printf( "counts: %zu clusters, %zu lines, %zu spaces\n", clusters, lines, spaces );
+
+    ual_buffer_release( ub );
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,125 @@
+//
+//  benchchat.cpp
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <ualyze.h>
+
+/*
+    Measure bidi analysis of short user interface strings, where user content
+    such as names and message text is wrapped in isolates.
+*/
+
+static const char16_t* const NAMES[] =
+{
+    u"Alice",
+    u"محمد",
+    u"דנה כהן",
+    u"Zoë_42",
+    u"Jean-Luc (work)",
+    u"علي ١٢",
+};
+
+static const char16_t* const MESSAGES[] =
+{
+    u"see you at 10:30!",
+    u"مرحبا، كيف حالك؟",
+    u"שלום (מה נשמע?)",
+    u"ok 👍",
+    u"the file is at https://example.com/a/b",
+    u"رقم الطلب 4521",
+};
+
+static const char16_t* const TEMPLATES[] =
+{
+    u"⁨%n⁩: ⁨%m⁩",
+    u"⁨%n⁩ replied to ⁨%n⁩",
+    u"⁨%n⁩ and ⁨%n⁩ are typing…",
+    u"ردّ ⁨%n⁩ على رسالتك: ⁨%m⁩",
+    u"New message from ⁦%n⁩",
+    u"⁧%n⁩ הגיב: ⁨%m⁩",
+};
+
+template < typename T, size_t N > static const char16_t* pick( T ( &array )[ N ], unsigned* seed )
+{
+    *seed = *seed * 1103515245 + 12345;
+    return array[ ( *seed >> 16 ) % N ];
+}
+
+int main( int argc, char* argv[] )
+{
+    size_t count = argc > 1 ? atoi( argv[ 1 ] ) : 10000;
+
+    // Build strings by filling in templates.
+    std::vector< std::u16string > strings;
+    size_t units = 0;
+    unsigned seed = 1;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        std::u16string s;
+        for ( const char16_t* t = pick( TEMPLATES, &seed ); *t; ++t )
+        {
+            if ( t[ 0 ] == '%' && t[ 1 ] == 'n' )
+            {
+                s.append( pick( NAMES, &seed ) );
+                t += 1;
+            }
+            else if ( t[ 0 ] == '%' && t[ 1 ] == 'm' )
+            {
+                s.append( pick( MESSAGES, &seed ) );
+                t += 1;
+            }
+            else
+            {
+                s.push_back( *t );
+            }
+        }
+        units += s.size();
+        strings.push_back( std::move( s ) );
+    }
+
+    printf( "strings: %zu, %zu units\n", strings.size(), units );
+
+    // Report the best of several runs.
+    ual_buffer* ub = ual_buffer_create();
+    const int ITERATIONS = 20;
+    double ms = INFINITY;
+    size_t runs = 0;
+    for ( int i = 0; i < ITERATIONS; ++i )
+    {
+        runs = 0;
+        auto start = std::chrono::steady_clock::now();
+        for ( const std::u16string& s : strings )
+        {
+            ual_analyze_paragraph( ub, s.data(), s.size() );
+            ual_analyze_bidi( ub, UAL_FROM_TEXT );
+
+            ual_bidi_run run;
+            ual_bidi_runs_begin( ub );
+            while ( ual_bidi_runs_next( ub, &run ) )
+            {
+                runs += 1;
+            }
+            ual_bidi_runs_end( ub );
+        }
+        auto finish = std::chrono::steady_clock::now();
+        ms = std::min( ms, std::chrono::duration< double, std::milli >( finish - start ).count() );
+    }
+
+    printf( "bidi: %.3f ms, %.2f ns/unit, %.1f ns/string, %zu runs\n", ms, ms * 1e6 / units, ms * 1e6 / strings.size(), runs );
+
+    ual_buffer_release( ub );
+    return EXIT_SUCCESS;
+}
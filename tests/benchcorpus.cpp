@@ -0,0 +1,330 @@
+//
+//  benchcorpus.cpp
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <ualyze.h>
+
+/*
+    Measure each analysis stage on a set of corpus files, and report the
+    results as JSON.  Each corpus is repeated until it is at least the
+    minimum size.  Stages are timed call by call over every paragraph, and the
+    best total of several iterations is reported.  Rates are per UTF-16 code
+    unit, which is the unit of ual_buffer_size.
+*/
+
+enum stage_index { PARAGRAPH, BREAKS, SCRIPT, BIDI, ARCHIVE, STAGE_COUNT };
+
+static const char* const STAGE_NAMES[ STAGE_COUNT ] = { "paragraph", "breaks", "script", "bidi", "archive" };
+
+typedef std::chrono::steady_clock clock_type;
+
+#define STATS_FIELD( name ) { #name, offsetof( ual_stats, name ) }
+
+static const struct { const char* name; size_t offset; } STATS_FIELDS[] =
+{
+    STATS_FIELD( break_paragraphs ),
+    STATS_FIELD( break_units ),
+    STATS_FIELD( break_ticks ),
+    STATS_FIELD( bidi_paragraphs ),
+    STATS_FIELD( bidi_units ),
+    STATS_FIELD( explicit_ticks ),
+    STATS_FIELD( weak_ticks ),
+    STATS_FIELD( brackets_ticks ),
+    STATS_FIELD( neutral_ticks ),
+    STATS_FIELD( whitespace_ticks ),
+    STATS_FIELD( runs_ticks ),
+    STATS_FIELD( level_runs ),
+    STATS_FIELD( brackets_pushed ),
+    STATS_FIELD( rewinds ),
+    STATS_FIELD( lookahead ),
+};
+
+static bool read_utf8( const char* path, std::u16string* out_text, size_t* out_codepoints )
+{
+    FILE* f = fopen( path, "rb" );
+    if ( ! f )
+    {
+        return false;
+    }
+
+    std::string data;
+    char buffer[ 4096 ];
+    while ( size_t size = fread( buffer, 1, sizeof( buffer ), f ) )
+    {
+        data.append( buffer, size );
+    }
+    fclose( f );
+
+    // Corpus files are valid UTF-8.
+    out_text->clear();
+    *out_codepoints = 0;
+    size_t i = 0;
+    while ( i < data.size() )
+    {
+        unsigned char lead = data[ i++ ];
+        char32_t c = lead;
+        unsigned trail = 0;
+        if ( lead >= 0xF0 )
+        {
+            c = lead & 0x07;
+            trail = 3;
+        }
+        else if ( lead >= 0xE0 )
+        {
+            c = lead & 0x0F;
+            trail = 2;
+        }
+        else if ( lead >= 0xC0 )
+        {
+            c = lead & 0x1F;
+            trail = 1;
+        }
+        while ( trail-- && i < data.size() )
+        {
+            c = ( c << 6 ) | ( data[ i++ ] & 0x3F );
+        }
+
+        if ( c >= 0x10000 )
+        {
+            out_text->push_back( (char16_t)( 0xD800 + ( ( c - 0x10000 ) >> 10 ) ) );
+            out_text->push_back( (char16_t)( 0xDC00 + ( ( c - 0x10000 ) & 0x3FF ) ) );
+        }
+        else
+        {
+            out_text->push_back( (char16_t)c );
+        }
+        *out_codepoints += 1;
+    }
+
+    return true;
+}
+
+static std::string corpus_name( const char* path )
+{
+    // Name is the file name without its extension.
+    const char* name = strrchr( path, '/' );
+    std::string result = name ? name + 1 : path;
+    return result.substr( 0, result.rfind( '.' ) );
+}
+
+int main( int argc, char* argv[] )
+{
+    size_t min_size = 256 * 1024;
+    int iterations = 10;
+    bool workload = false;
+
+    std::vector< const char* > paths;
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( strcmp( argv[ i ], "--size" ) == 0 && i + 1 < argc )
+            min_size = atoi( argv[ ++i ] );
+        else if ( strcmp( argv[ i ], "--iterations" ) == 0 && i + 1 < argc )
+            iterations = atoi( argv[ ++i ] );
+        else if ( strcmp( argv[ i ], "--workload" ) == 0 )
+            workload = true;
+        else
+            paths.push_back( argv[ i ] );
+    }
+
+    if ( paths.empty() )
+    {
+        fprintf( stderr, "usage: benchcorpus [--size units] [--iterations n] [--workload] corpus...\n" );
+        return EXIT_FAILURE;
+    }
+
+    printf( "{\n" );
+#if defined( UAL_WIDE )
+    printf( "  \"layout\": \"wide\",\n" );
+#else
+    printf( "  \"layout\": \"narrow\",\n" );
+#endif
+#if defined( UAL_BREAK_PRODUCT )
+    printf( "  \"machine\": \"product\",\n" );
+#else
+    printf( "  \"machine\": \"separate\",\n" );
+#endif
+    printf( "  \"iterations\": %d,\n", iterations );
+    printf( "  \"corpora\": [\n" );
+
+    ual_workload_enable( workload );
+
+    ual_buffer* ub = ual_buffer_create();
+    for ( size_t icorpus = 0; icorpus < paths.size(); ++icorpus )
+    {
+        std::u16string corpus;
+        size_t corpus_codepoints = 0;
+        if ( ! read_utf8( paths[ icorpus ], &corpus, &corpus_codepoints ) || corpus.empty() )
+        {
+            fprintf( stderr, "cannot read corpus %s\n", paths[ icorpus ] );
+            return EXIT_FAILURE;
+        }
+
+        // Repeat corpus up to the minimum size.
+        std::u16string text;
+        size_t codepoints = 0;
+        while ( text.size() < min_size )
+        {
+            text.append( corpus );
+            codepoints += corpus_codepoints;
+        }
+
+        // Build an archive of the results, outside workload collection.
+        ual_workload_enable( false );
+        ual_archive_writer* aw = ual_archive_writer_create();
+        for ( size_t lower = 0; lower < text.size(); )
+        {
+            lower += ual_analyze_paragraph( ub, text.data() + lower, text.size() - lower );
+            ual_archive_writer_add( aw, ub, UAL_FROM_TEXT );
+        }
+        ual_workload_enable( workload );
+
+        size_t archive_size = 0;
+        const void* archive_data = ual_archive_writer_data( aw, &archive_size );
+        ual_archive archive;
+        ual_archive_open( &archive, archive_data, archive_size );
+
+        double best[ STAGE_COUNT ];
+        std::fill( best, best + STAGE_COUNT, INFINITY );
+        size_t paragraphs = 0;
+        ual_buffer_stats_reset( ub );
+        for ( int i = 0; i < iterations; ++i )
+        {
+            double total[ STAGE_COUNT ] = {};
+            paragraphs = 0;
+
+            const char16_t* p = text.data();
+            size_t size = text.size();
+            while ( size )
+            {
+                auto t0 = clock_type::now();
+                size_t length = ual_analyze_paragraph( ub, p, size );
+                auto t1 = clock_type::now();
+                ual_analyze_breaks( ub );
+                auto t2 = clock_type::now();
+                ual_analyze_bidi( ub, UAL_FROM_TEXT );
+                auto t3 = clock_type::now();
+                ual_script_span span;
+                ual_script_spans_begin( ub );
+                while ( ual_script_spans_next( ub, &span ) )
+                {
+                }
+                ual_script_spans_end( ub );
+                auto t4 = clock_type::now();
+
+                total[ PARAGRAPH ] += std::chrono::duration< double, std::nano >( t1 - t0 ).count();
+                total[ BREAKS ] += std::chrono::duration< double, std::nano >( t2 - t1 ).count();
+                total[ BIDI ] += std::chrono::duration< double, std::nano >( t3 - t2 ).count();
+                total[ SCRIPT ] += std::chrono::duration< double, std::nano >( t4 - t3 ).count();
+
+                paragraphs += 1;
+                p += length;
+                size -= length;
+            }
+
+            // Read the same results from the archive.
+            auto t0 = clock_type::now();
+            for ( size_t index = 0; index < archive.paragraph_count; ++index )
+            {
+                ual_archive_paragraph ap;
+                ual_archive_paragraph_get( &archive, index, &ap );
+
+                ual_break_list list;
+                ual_archive_break_list_get( &ap, UAL_BREAK_LINE, &list );
+                const uint8_t* varint = list.varint;
+                ual_position position = 0;
+                for ( size_t i = 0; i < list.count; ++i )
+                {
+                    varint = ual_varint_next( varint, &position );
+                }
+
+                ual_archive_iterator it;
+                ual_script_span span;
+                ual_archive_script_spans_begin( &ap, &it );
+                while ( ual_archive_script_spans_next( &it, &span ) )
+                {
+                }
+
+                ual_bidi_run run;
+                ual_archive_bidi_runs_begin( &ap, &it );
+                while ( ual_archive_bidi_runs_next( &it, &run ) )
+                {
+                }
+            }
+            auto t1 = clock_type::now();
+            total[ ARCHIVE ] = std::chrono::duration< double, std::nano >( t1 - t0 ).count();
+
+            for ( size_t stage = 0; stage < STAGE_COUNT; ++stage )
+            {
+                best[ stage ] = std::min( best[ stage ], total[ stage ] );
+            }
+        }
+
+        printf( "    {\n" );
+        printf( "      \"name\": \"%s\",\n", corpus_name( paths[ icorpus ] ).c_str() );
+        printf( "      \"units\": %zu,\n", text.size() );
+        printf( "      \"codepoints\": %zu,\n", codepoints );
+        printf( "      \"paragraphs\": %zu,\n", paragraphs );
+        printf( "      \"archive_bytes\": %zu,\n", archive_size );
+        printf( "      \"stages\": {\n" );
+        for ( size_t stage = 0; stage < STAGE_COUNT; ++stage )
+        {
+            double ns_per_char = best[ stage ] / text.size();
+            printf
+            (
+                "        \"%s\": { \"ns\": %.0f, \"ns_per_char\": %.3f, \"chars_per_second\": %.0f }%s\n",
+                STAGE_NAMES[ stage ],
+                best[ stage ],
+                ns_per_char,
+                1e9 / ns_per_char,
+                stage + 1 < STAGE_COUNT ? "," : ""
+            );
+        }
+        printf( "      }" );
+
+        // Counters from an instrumented build, over all iterations.
+        ual_stats stats;
+        if ( ual_buffer_stats( ub, &stats ) )
+        {
+            printf( ",\n      \"stats\": {\n" );
+            size_t field_count = sizeof( STATS_FIELDS ) / sizeof( STATS_FIELDS[ 0 ] );
+            for ( size_t i = 0; i < field_count; ++i )
+            {
+                uint64_t value = *(const uint64_t*)( (const char*)&stats + STATS_FIELDS[ i ].offset );
+                printf( "        \"%s\": %llu%s\n", STATS_FIELDS[ i ].name, (unsigned long long)value, i + 1 < field_count ? "," : "" );
+            }
+            printf( "      }" );
+        }
+
+        printf( "\n    }%s\n", icorpus + 1 < paths.size() ? "," : "" );
+        ual_archive_writer_release( aw );
+    }
+    ual_buffer_release( ub );
+
+    printf( "  ]\n" );
+    printf( "}\n" );
+
+    // Workload statistics go to stderr, to keep the JSON intact.
+    if ( workload )
+    {
+        std::vector< char > dump( ual_workload_dump( nullptr, 0 ) + 1 );
+        ual_workload_dump( dump.data(), dump.size() );
+        fputs( dump.data(), stderr );
+    }
+
+    return EXIT_SUCCESS;
+}
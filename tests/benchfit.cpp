@@ -0,0 +1,151 @@
+//
+//  benchfit.cpp
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <ualyze.h>
+
+/*
+    Compare greedy and total-fit line breaking on a long synthetic paragraph.
+*/
+
+static const char* const WORDS[] =
+{
+    "a", "an", "the", "of", "and", "in", "to", "is", "was", "it", "for",
+    "with", "paragraph", "line", "breaking", "algorithm", "optimal",
+    "typography", "justification", "demerits", "glue", "penalty", "box",
+    "hyphenation", "Knuth", "Plass", "total-fit", "first-fit", "width",
+    "incomprehensibilities", "antidisestablishmentarianism", "quick", "fox",
+};
+
+static float advance( char16_t c )
+{
+    switch ( c )
+    {
+    case 'i': case 'l': case 'j': case 't': case 'f': case '-':
+        return 0.5f;
+    case 'm': case 'w': case 'M': case 'W':
+        return 1.5f;
+    case ' ':
+        return 0.75f;
+    default:
+        return 1.0f;
+    }
+}
+
+static double fit_quality( ual_buffer* ub )
+{
+    // Sum of squared adjustment ratios, excluding the last line.
+    double quality = 0.0;
+    ual_line line;
+    ual_lines_begin( ub );
+    while ( ual_lines_next( ub, &line ) )
+    {
+        if ( line.upper < ual_buffer_size( ub ) )
+        {
+            double ratio = std::min( fabs( line.ratio ), 10.0f );
+            quality += ratio * ratio;
+        }
+    }
+    ual_lines_end( ub );
+    return quality;
+}
+
+int main( int argc, char* argv[] )
+{
+    size_t line_count = argc > 1 ? atoi( argv[ 1 ] ) : 10000;
+    float line_width = 60.0f;
+
+    // Build paragraph of roughly the requested number of lines.
+    std::u16string text;
+    unsigned seed = 1;
+    while ( text.size() < line_count * line_width )
+    {
+        seed = seed * 1103515245 + 12345;
+        const char* word = WORDS[ ( seed >> 16 ) % ( sizeof( WORDS ) / sizeof( WORDS[ 0 ] ) ) ];
+        if ( text.size() )
+        {
+            text.push_back( ' ' );
+        }
+        while ( *word )
+        {
+            text.push_back( *word++ );
+        }
+    }
+    text.push_back( '.' );
+
+    std::vector< float > advances;
+    for ( char16_t c : text )
+    {
+        advances.push_back( advance( c ) );
+    }
+
+    ual_buffer* ub = ual_buffer_create();
+    ual_analyze_paragraph( ub, text.data(), text.size() );
+    ual_analyze_breaks( ub );
+
+    ual_fit_params params = { line_width, 0.5f, 0.33f, 0, nullptr, nullptr };
+    printf( "paragraph: %zu chars\n", text.size() );
+
+    for ( int optimal = 0; optimal < 2; ++optimal )
+    {
+        const int ITERATIONS = 10;
+        size_t lines = 0;
+        auto start = std::chrono::steady_clock::now();
+        for ( int i = 0; i < ITERATIONS; ++i )
+        {
+            if ( optimal )
+                lines = ual_fit_optimal( ub, advances.data(), &params );
+            else
+                lines = ual_fit_greedy( ub, advances.data(), &params );
+        }
+        auto finish = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration< double, std::milli >( finish - start ).count() / ITERATIONS;
+
+        printf
+        (
+            "%-8s %zu lines, %.3f ms, %.1f ns/char, quality %.1f\n",
+            optimal ? "optimal" : "greedy",
+            lines,
+            ms,
+            ms * 1e6 / text.size(),
+            fit_quality( ub )
+        );
+    }
+
+    // Reflow at many widths using a skeleton.
+    ual_skeleton* sk = ual_skeleton_create( ub, advances.data() );
+    ual_buffer* uq = ual_buffer_create();
+    auto start = std::chrono::steady_clock::now();
+    size_t mismatches = 0;
+    for ( float width = 40.0f; width < 80.0f; width += 1.0f )
+    {
+        ual_fit_params reflow = params;
+        reflow.width = width;
+        size_t count = ual_skeleton_greedy( sk, uq, &reflow );
+        if ( count != ual_fit_greedy( ub, advances.data(), &reflow ) )
+        {
+            mismatches += 1;
+        }
+    }
+    auto finish = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration< double, std::milli >( finish - start ).count() / 40;
+    printf( "reflow   %.3f ms per width (including check), %zu mismatches\n", ms, mismatches );
+    ual_skeleton_release( sk );
+    ual_buffer_release( uq );
+
+    ual_buffer_release( ub );
+    return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+//
+//  benchfused.cpp
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <ualyze.h>
+
+/*
+    Compare separate paragraph, break, and bidi analysis with fused analysis
+    followed by bidi analysis.  The default paragraph is much larger than a
+    typical L2 cache, so each pass over the paragraph streams from memory.
+*/
+
+static const char16_t* const SAMPLES[] =
+{
+    u"The quick brown fox jumps over the lazy dog. ",
+    u"Prices rose by 12.5% to $1,234.56 (in 2019) - see §4.2. ",
+    u"日本語の文章。これはテストです。",
+    u"مرحبا بالعالم ",
+    u"\U0001F468‍\U0001F469‍\U0001F467 \U0001F44D\U0001F3FD \U0001F1EC\U0001F1E7 ",
+    u"é ä क्ष 한국어 ",
+    u"1 2 3 -4 +5 (6) [7] 8.9 10,11 ",
+};
+
+typedef std::chrono::steady_clock clock_type;
+
+static double elapsed_ms( clock_type::time_point start, clock_type::time_point finish )
+{
+    return std::chrono::duration< double, std::milli >( finish - start ).count();
+}
+
+int main( int argc, char* argv[] )
+{
+    size_t size = argc > 1 ? atoi( argv[ 1 ] ) : 8 * 1024 * 1024;
+
+    // Build paragraph from samples.
+    std::u16string text;
+    unsigned seed = 1;
+    while ( text.size() < size )
+    {
+        seed = seed * 1103515245 + 12345;
+        text.append( SAMPLES[ ( seed >> 16 ) % ( sizeof( SAMPLES ) / sizeof( SAMPLES[ 0 ] ) ) ] );
+    }
+    size = text.size();
+    printf( "paragraph: %zu units\n", size );
+
+    ual_buffer* ub = ual_buffer_create();
+    ual_buffer_options( ub, UAL_OPTION_BREAK_LISTS );
+
+    // Report the best of several runs of each.
+    const int ITERATIONS = 10;
+    double separate_breaks = INFINITY, separate_total = INFINITY;
+    double fused_breaks = INFINITY, fused_total = INFINITY;
+    for ( int i = 0; i < ITERATIONS; ++i )
+    {
+        auto start = clock_type::now();
+        ual_analyze_paragraph( ub, text.data(), text.size() );
+        ual_analyze_breaks( ub );
+        auto split = clock_type::now();
+        ual_analyze_bidi( ub, UAL_FROM_TEXT );
+        auto finish = clock_type::now();
+        separate_breaks = std::min( separate_breaks, elapsed_ms( start, split ) );
+        separate_total = std::min( separate_total, elapsed_ms( start, finish ) );
+
+        start = clock_type::now();
+        ual_analyze_all( ub, text.data(), text.size() );
+        split = clock_type::now();
+        ual_analyze_bidi( ub, UAL_FROM_TEXT );
+        finish = clock_type::now();
+        fused_breaks = std::min( fused_breaks, elapsed_ms( start, split ) );
+        fused_total = std::min( fused_total, elapsed_ms( start, finish ) );
+    }
+
+    printf( "separate: %.3f ms breaks, %.3f ms total, %.2f ns/unit\n", separate_breaks, separate_total, separate_total * 1e6 / size );
+    printf( "fused:    %.3f ms breaks, %.3f ms total, %.2f ns/unit\n", fused_breaks, fused_total, fused_total * 1e6 / size );
+
+    ual_buffer_release( ub );
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+//
+//  benchtemplate.cpp
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <ualyze.h>
+#include <ualyze_template.h>
+
+/*
+    Compare break analysis through the C API with the fused loops of the
+    template front end, for all breaks and for cluster breaks only.
+*/
+
+static const char16_t* const SAMPLES[] =
+{
+    u"The quick brown fox jumps over the lazy dog. ",
+    u"Prices rose by 12.5% to $1,234.56 (in 2019) - see §4.2. ",
+    u"日本語の文章。これはテストです。",
+    u"مرحبا بالعالم ",
+    u"\U0001F468‍\U0001F469‍\U0001F467 \U0001F44D\U0001F3FD \U0001F1EC\U0001F1E7 ",
+    u"é ä क्ष 한국어 ",
+    u"1 2 3 -4 +5 (6) [7] 8.9 10,11 ",
+};
+
+struct count_sink
+{
+    size_t cluster_count = 0;
+    size_t line_count = 0;
+    size_t space_count = 0;
+
+    void cluster( size_t index ) { cluster_count += 1; }
+    void line( size_t index ) { line_count += 1; }
+    void spaces( size_t index ) { space_count += 1; }
+    void paragraph( size_t lower, size_t upper ) {}
+};
+
+template < typename F >
+static double best_ms( F f )
+{
+    const int ITERATIONS = 50;
+    double ms = INFINITY;
+    for ( int i = 0; i < ITERATIONS; ++i )
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto finish = std::chrono::steady_clock::now();
+        ms = std::min( ms, std::chrono::duration< double, std::milli >( finish - start ).count() );
+    }
+    return ms;
+}
+
+int main( int argc, char* argv[] )
+{
+    size_t size = argc > 1 ? atoi( argv[ 1 ] ) : 1024 * 1024;
+
+    // Build paragraph from samples.
+    std::u16string text;
+    unsigned seed = 1;
+    while ( text.size() < size )
+    {
+        seed = seed * 1103515245 + 12345;
+        text.append( SAMPLES[ ( seed >> 16 ) % ( sizeof( SAMPLES ) / sizeof( SAMPLES[ 0 ] ) ) ] );
+    }
+    size = text.size();
+    printf( "paragraph: %zu units\n", size );
+
+    // C API, counting breaks from the lists.
+    ual_buffer* ub = ual_buffer_create();
+    ual_buffer_options( ub, UAL_OPTION_BREAK_LISTS );
+    size_t lines = 0;
+    double ms = best_ms( [ & ]()
+    {
+        ual_analyze_paragraph( ub, text.data(), text.size() );
+        ual_analyze_breaks( ub );
+        ual_break_list list;
+        ual_break_list_get( ub, UAL_BREAK_LINE, &list );
+        lines = list.count;
+    } );
+    printf( "c api:    %.3f ms, %.2f ns/unit, %zu lines\n", ms, ms * 1e6 / size, lines );
+    ual_buffer_release( ub );
+
+    // Template, all breaks.
+    count_sink sink;
+    ms = best_ms( [ & ]()
+    {
+        sink = count_sink();
+        ual::analyze< ual::breaks >( text.data(), text.size(), sink );
+    } );
+    printf( "breaks:   %.3f ms, %.2f ns/unit, %zu lines\n", ms, ms * 1e6 / size, sink.line_count );
+
+    // Template, cluster breaks only.
+    ms = best_ms( [ & ]()
+    {
+        sink = count_sink();
+        ual::analyze< ual::clusters >( text.data(), text.size(), sink );
+    } );
+    printf( "clusters: %.3f ms, %.2f ns/unit, %zu clusters\n", ms, ms * 1e6 / size, sink.cluster_count );
+
+    return EXIT_SUCCESS;
+}
@@ -69,27 +69,30 @@ int main( int argc, char* argv[] )
     unsigned high_level = 0;
     unsigned lodd_level = UINT_MAX;
 
-    printf( "@Levels:\t" );
     ual_bidi_runs_begin( ub );
     while ( ual_bidi_runs_next( ub, &run ) )
     {
         runs.push_back( run );
         if ( run.level > high_level ) high_level = run.level;
         if ( ( run.level & 1 ) != 0 && run.level < lodd_level ) lodd_level = run.level;
+    }
+    ual_bidi_runs_end( ub );
+
+    std::vector< uint8_t > levels( ual_buffer_size( ub ) );
+    ual_bidi_levels( ub, levels.data() );
 
-        for ( size_t index = run.lower; index < run.upper; ++index )
+    printf( "@Levels:\t" );
+    for ( size_t index = 0; index < levels.size(); ++index )
+    {
+        if ( b[ index ].bc != UCDB_BIDI_BN )
         {
-            if ( b[ index ].bc != UCDB_BIDI_BN )
-            {
-                printf( "%u ", run.level );
-            }
-            else
-            {
-                printf( "x " );
-            }
+            printf( "%u ", levels[ index ] );
+        }
+        else
+        {
+            printf( "x " );
         }
     }
-    ual_bidi_runs_end( ub );
     printf( "\n" );
 
     if ( lodd_level != UINT_MAX )
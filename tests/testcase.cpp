@@ -11,14 +11,19 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <vector>
+#include <algorithm>
 #include <string.h>
+#include <math.h>
 #include <ualyze.h>
 #include "../source/ual_buffer.h"
+#include <ualyze_template.h>
+#include <ualyze_literal.h>
 
 void bidi_initial( ual_buffer* ub, unsigned override_paragraph_level );
 void bidi_weak( ual_buffer* ub );
 void bidi_brackets( ual_buffer* ub );
 void bidi_neutral( ual_buffer* ub );
+void bidi_strong( ual_buffer* ub );
 
 static char boundary_class( unsigned bc )
 {
@@ -65,6 +70,828 @@ static const char* bidi_class( unsigned bc )
     }
 }
 
+static bool check_break_list( ual_buffer* ub, uint16_t break_flag )
+{
+    // Lists must contain exactly the positions with the flag set.
+    ual_break_list list;
+    if ( ! ual_break_list_get( ub, break_flag, &list ) )
+    {
+        return false;
+    }
+
+    const ual_char* c = ual_buffer_chars( ub );
+    size_t count = ual_buffer_size( ub );
+    size_t ilist = 0;
+    const uint8_t* p = list.varint;
+    ual_position position = 0;
+    for ( size_t index = 0; index < count; ++index )
+    {
+        if ( c[ index ].bc & break_flag )
+        {
+            if ( ilist >= list.count || list.positions[ ilist ] != index )
+            {
+                return false;
+            }
+
+            p = ual_varint_next( p, &position );
+            if ( position != index )
+            {
+                return false;
+            }
+
+            ilist += 1;
+        }
+    }
+
+    return ilist == list.count && p == list.varint + list.varint_size;
+}
+
+static bool check_cluster_index( ual_buffer* ub )
+{
+    // Compare index queries with a linear scan of cluster flags.
+    const ual_char* c = ual_buffer_chars( ub );
+    size_t count = ual_buffer_size( ub );
+    size_t cluster = 0;
+    size_t lower = 0;
+    for ( size_t index = 0; index < count; ++index )
+    {
+        if ( index > 0 && ( c[ index ].bc & UAL_BREAK_CLUSTER ) )
+        {
+            cluster += 1;
+            lower = index;
+        }
+
+        size_t upper = index + 1;
+        while ( upper < count && ! ( c[ upper ].bc & UAL_BREAK_CLUSTER ) )
+        {
+            upper += 1;
+        }
+
+        if ( ual_cluster_of( ub, index ) != cluster
+            || ual_cluster_start( ub, cluster ) != lower
+            || ual_cluster_next( ub, index ) != upper
+            || ual_cluster_prev( ub, index + 1 ) != lower )
+        {
+            return false;
+        }
+    }
+
+    return ual_cluster_count( ub ) == ( count ? cluster + 1 : 0 );
+}
+
+static bool check_bidi_levels( ual_buffer* ub )
+{
+    // Levels must match bidi runs.
+    size_t count = ual_buffer_size( ub );
+    std::vector< uint8_t > levels( count );
+    ual_bidi_levels( ub, levels.data() );
+
+    ual_bidi_run run;
+    bool match = true;
+    ual_bidi_runs_begin( ub );
+    while ( ual_bidi_runs_next( ub, &run ) )
+    {
+        for ( size_t index = run.lower; index < run.upper; ++index )
+        {
+            match = match && levels[ index ] == run.level;
+        }
+    }
+    ual_bidi_runs_end( ub );
+
+    // Rule L1 has already been applied at the end of the paragraph.
+    std::vector< uint8_t > line_levels( count );
+    ual_bidi_line_levels( ub, 0, count, line_levels.data() );
+    return match && levels == line_levels;
+}
+
+static bool check_bidi_sequences( ual_buffer* ub )
+{
+    // Sequences must cover each unit exactly once, with ranges in order.
+    std::vector< unsigned > covered( ual_buffer_size( ub ) );
+    ual_bidi_sequence sequence;
+    bool match = true;
+    ual_bidi_sequences_begin( ub );
+    while ( ual_bidi_sequences_next( ub, &sequence ) )
+    {
+        size_t last = 0;
+        for ( size_t i = 0; i < sequence.range_count; ++i )
+        {
+            const ual_bidi_range& range = sequence.ranges[ i ];
+            match = match && range.lower >= last && range.lower < range.upper;
+            for ( size_t index = range.lower; index < range.upper; ++index )
+            {
+                covered[ index ] += 1;
+            }
+            last = range.upper;
+        }
+    }
+    ual_bidi_sequences_end( ub );
+
+    for ( unsigned count : covered )
+    {
+        match = match && count == 1;
+    }
+    return match;
+}
+
+static bool check_bidi_batch( ual_buffer* ub, std::u16string_view text, unsigned override_paragraph_level, unsigned paragraph_level, const std::vector< ual_bidi_run >& runs )
+{
+    // Batch analysis of the whole text must match analysis by paragraph.
+    ual_bidi_batch_string string = { text.data(), text.size() };
+    ual_bidi_batch_result result;
+    std::vector< ual_bidi_run > batch_runs( runs.size() + 1 );
+    if ( ual_analyze_bidi_batch( ub, &string, 1, override_paragraph_level, &result, batch_runs.data(), batch_runs.size() ) != 1 )
+    {
+        return false;
+    }
+
+    bool match = result.paragraph_level == paragraph_level && result.run_index == 0 && result.run_count == runs.size();
+    for ( size_t i = 0; match && i < runs.size(); ++i )
+    {
+        const ual_bidi_run& a = runs[ i ];
+        const ual_bidi_run& b = batch_runs[ i ];
+        match = a.lower == b.lower && a.upper == b.upper && a.level == b.level;
+    }
+    return match;
+}
+
+static std::vector< size_t > cache_results( ual_buffer* ub, std::u16string_view text, unsigned override_paragraph_level, bool bidi )
+{
+    // Flatten the results of analysis of each paragraph.
+    std::vector< size_t > results;
+    size_t plower = 0;
+    while ( size_t length = ual_analyze_paragraph( ub, text.data() + plower, text.size() - plower ) )
+    {
+        plower += length;
+
+        ual_analyze_breaks( ub );
+        const ual_char* c = ual_buffer_chars( ub );
+        for ( size_t index = 0; index < length; ++index )
+        {
+            results.push_back( c[ index ].bc );
+        }
+
+        ual_break_list list;
+        ual_break_list_get( ub, UAL_BREAK_LINE, &list );
+        results.insert( results.end(), list.positions, list.positions + list.count );
+        results.push_back( ual_cluster_count( ub ) );
+
+        ual_script_span span;
+        ual_script_spans_begin( ub );
+        while ( ual_script_spans_next( ub, &span ) )
+        {
+            results.insert( results.end(), { span.lower, span.upper, span.script } );
+        }
+        ual_script_spans_end( ub );
+
+        if ( ! bidi )
+        {
+            continue;
+        }
+
+        results.push_back( ual_analyze_bidi( ub, override_paragraph_level ) );
+
+        ual_bidi_run run;
+        ual_bidi_runs_begin( ub );
+        while ( ual_bidi_runs_next( ub, &run ) )
+        {
+            results.insert( results.end(), { run.lower, run.upper, run.level } );
+            size_t mirror_count = 0;
+            const ual_bidi_mirror* mirrors = ual_bidi_run_mirrors( ub, &mirror_count );
+            for ( size_t i = 0; i < mirror_count; ++i )
+            {
+                results.insert( results.end(), { mirrors[ i ].index, mirrors[ i ].mirror } );
+            }
+        }
+        ual_bidi_runs_end( ub );
+
+        ual_bidi_sequence sequence;
+        ual_bidi_sequences_begin( ub );
+        while ( ual_bidi_sequences_next( ub, &sequence ) )
+        {
+            results.insert( results.end(), { sequence.level, sequence.sos, sequence.eos } );
+            for ( size_t i = 0; i < sequence.range_count; ++i )
+            {
+                results.insert( results.end(), { sequence.ranges[ i ].lower, sequence.ranges[ i ].upper } );
+            }
+        }
+        ual_bidi_sequences_end( ub );
+
+        std::vector< uint8_t > levels( length );
+        ual_bidi_line_levels( ub, 0, length, levels.data() );
+        results.insert( results.end(), levels.begin(), levels.end() );
+    }
+    return results;
+}
+
+static bool check_cache( std::u16string_view text, unsigned override_paragraph_level, bool bidi )
+{
+    // Results restored from the cache must match the results of analysis.
+    ual_buffer* ub = ual_buffer_create();
+    ual_buffer_options( ub, UAL_OPTION_BREAK_LISTS | UAL_OPTION_CLUSTER_INDEX | UAL_OPTION_BIDI_MIRRORS );
+    std::vector< size_t > expected = cache_results( ub, text, override_paragraph_level, bidi );
+
+    ual_cache* cache = ual_cache_create( 1 << 20 );
+    ual_buffer_cache( ub, cache );
+    bool match = cache_results( ub, text, override_paragraph_level, bidi ) == expected;
+
+    // Every lookup in the second pass is a hit.
+    ual_cache_stats before, after;
+    ual_cache_stats_get( cache, &before );
+    match = match && cache_results( ub, text, override_paragraph_level, bidi ) == expected;
+    ual_cache_stats_get( cache, &after );
+    match = match && after.hits - before.hits == after.lookups - before.lookups;
+    ual_cache_release( cache );
+
+    // Sections added by different buffers to the same record are all kept.
+    cache = ual_cache_create( 1 << 20 );
+    ual_buffer* other = ual_buffer_create();
+    ual_buffer_cache( ub, cache );
+    ual_buffer_cache( other, cache );
+    ual_analyze_paragraph( ub, text.data(), text.size() );
+    ual_analyze_paragraph( other, text.data(), text.size() );
+    ual_analyze_breaks( ub );
+    ual_script_span span;
+    ual_script_spans_begin( other );
+    while ( ual_script_spans_next( other, &span ) )
+    {
+    }
+    ual_script_spans_end( other );
+
+    ual_cache_stats_get( cache, &before );
+    ual_analyze_paragraph( ub, text.data(), text.size() );
+    ual_analyze_breaks( ub );
+    ual_script_spans_begin( ub );
+    while ( ual_script_spans_next( ub, &span ) )
+    {
+    }
+    ual_script_spans_end( ub );
+    ual_cache_stats_get( cache, &after );
+    match = match && after.insertions == before.insertions;
+
+    ual_buffer_release( other );
+    ual_buffer_release( ub );
+    ual_cache_release( cache );
+    return match;
+}
+
+static bool check_archive( std::u16string_view text, unsigned override_paragraph_level )
+{
+    // Results read from an archive must match the results of analysis.
+    ual_buffer* ub = ual_buffer_create();
+    ual_archive_writer* aw = ual_archive_writer_create();
+    size_t plower = 0;
+    while ( size_t length = ual_analyze_paragraph( ub, text.data() + plower, text.size() - plower ) )
+    {
+        ual_archive_writer_add( aw, ub, override_paragraph_level );
+        plower += length;
+    }
+
+    size_t size = 0;
+    const void* data = ual_archive_writer_data( aw, &size );
+    ual_archive archive;
+    bool match = ual_archive_open( &archive, data, size );
+
+    ual_buffer_options( ub, UAL_OPTION_BREAK_LISTS );
+    plower = 0;
+    size_t index = 0;
+    while ( size_t length = ual_analyze_paragraph( ub, text.data() + plower, text.size() - plower ) )
+    {
+        ual_archive_paragraph ap;
+        match = match && ual_archive_paragraph_get( &archive, index++, &ap );
+        match = match && ap.text_offset == plower && ap.length == length;
+        plower += length;
+
+        ual_analyze_breaks( ub );
+        for ( uint16_t break_flag : { UAL_BREAK_CLUSTER, UAL_BREAK_LINE, UAL_BREAK_SPACES } )
+        {
+            ual_break_list a, b;
+            ual_break_list_get( ub, break_flag, &a );
+            match = match && ual_archive_break_list_get( &ap, break_flag, &b ) && a.count == b.count;
+            const uint8_t* p = b.varint;
+            ual_position position = 0;
+            for ( size_t i = 0; match && i < a.count; ++i )
+            {
+                p = ual_varint_next( p, &position );
+                match = position == a.positions[ i ];
+            }
+            match = match && p == b.varint + b.varint_size;
+        }
+
+        ual_script_span a, b;
+        ual_archive_iterator it;
+        ual_archive_script_spans_begin( &ap, &it );
+        ual_script_spans_begin( ub );
+        while ( match && ual_script_spans_next( ub, &a ) )
+        {
+            match = ual_archive_script_spans_next( &it, &b ) && a.lower == b.lower && a.upper == b.upper && a.script == b.script;
+        }
+        ual_script_spans_end( ub );
+        match = match && ! ual_archive_script_spans_next( &it, &b );
+
+        match = match && ual_analyze_bidi( ub, override_paragraph_level ) == ap.paragraph_level;
+        ual_bidi_run ra, rb;
+        ual_archive_bidi_runs_begin( &ap, &it );
+        ual_bidi_runs_begin( ub );
+        while ( match && ual_bidi_runs_next( ub, &ra ) )
+        {
+            match = ual_archive_bidi_runs_next( &it, &rb ) && ra.lower == rb.lower && ra.upper == rb.upper && ra.level == rb.level;
+        }
+        ual_bidi_runs_end( ub );
+        match = match && ! ual_archive_bidi_runs_next( &it, &rb );
+    }
+    match = match && index == archive.paragraph_count;
+
+    // Reading stays inside the sections of a corrupt paragraph.
+    const uint8_t* bytes = (const uint8_t*)data;
+    std::vector< uint8_t > corrupt( bytes, bytes + size );
+    std::fill( corrupt.begin() + 16 + archive.paragraph_count * 40, corrupt.end(), 0xFF );
+    match = match && ual_archive_open( &archive, corrupt.data(), corrupt.size() );
+    for ( index = 0; match && index < archive.paragraph_count; ++index )
+    {
+        ual_archive_paragraph ap;
+        match = ual_archive_paragraph_get( &archive, index, &ap );
+        for ( uint16_t break_flag : { UAL_BREAK_CLUSTER, UAL_BREAK_LINE, UAL_BREAK_SPACES } )
+        {
+            ual_break_list list;
+            match = match && ! ual_archive_break_list_get( &ap, break_flag, &list );
+        }
+
+        ual_archive_iterator it;
+        ual_script_span span;
+        ual_archive_script_spans_begin( &ap, &it );
+        match = match && ! ual_archive_script_spans_next( &it, &span );
+        ual_bidi_run run;
+        ual_archive_bidi_runs_begin( &ap, &it );
+        match = match && ! ual_archive_bidi_runs_next( &it, &run );
+    }
+
+    ual_archive_writer_release( aw );
+    ual_buffer_release( ub );
+    return match;
+}
+
+static bool check_fused( std::u16string_view text, unsigned override_paragraph_level )
+{
+    // Fused analysis must match separate paragraph, break, and bidi analysis.
+    const unsigned options = UAL_OPTION_BREAK_LISTS | UAL_OPTION_BREAK_VARINT | UAL_OPTION_CLUSTER_INDEX;
+    ual_buffer* ua = ual_buffer_create();
+    ual_buffer* ub = ual_buffer_create();
+    ual_buffer_options( ua, options );
+    ual_buffer_options( ub, options );
+
+    bool match = true;
+    size_t plower = 0;
+    while ( match && plower < text.size() )
+    {
+        size_t length = ual_analyze_paragraph( ua, text.data() + plower, text.size() - plower );
+        ual_analyze_breaks( ua );
+        match = ual_analyze_all( ub, text.data() + plower, text.size() - plower ) == length;
+        plower += length;
+
+        const ual_char* a = ual_buffer_chars( ua );
+        const ual_char* b = ual_buffer_chars( ub );
+        for ( size_t i = 0; match && i < length; ++i )
+        {
+            match = a[ i ].bc == b[ i ].bc;
+        }
+
+        match = match
+            && check_break_list( ub, UAL_BREAK_CLUSTER )
+            && check_break_list( ub, UAL_BREAK_LINE )
+            && check_break_list( ub, UAL_BREAK_SPACES )
+            && check_cluster_index( ub );
+
+        match = match && ual_analyze_bidi( ua, override_paragraph_level ) == ual_analyze_bidi( ub, override_paragraph_level );
+        for ( size_t i = 0; match && i < length; ++i )
+        {
+            match = a[ i ].bc == b[ i ].bc;
+        }
+
+        ual_bidi_run ra, rb;
+        ual_bidi_runs_begin( ua );
+        ual_bidi_runs_begin( ub );
+        while ( match && ual_bidi_runs_next( ua, &ra ) )
+        {
+            match = ual_bidi_runs_next( ub, &rb ) && ra.lower == rb.lower && ra.upper == rb.upper && ra.level == rb.level;
+        }
+        match = match && ! ual_bidi_runs_next( ub, &rb );
+        ual_bidi_runs_end( ua );
+        ual_bidi_runs_end( ub );
+    }
+
+    ual_buffer_release( ua );
+    ual_buffer_release( ub );
+    return match;
+}
+
+struct template_sink
+{
+    std::vector< size_t > lists[ 3 ];
+    std::vector< size_t > paragraphs;
+    std::vector< ual_script_span > spans;
+    std::vector< ual_bidi_run > runs;
+
+    void cluster( size_t index ) { lists[ 0 ].push_back( index ); }
+    void line( size_t index ) { lists[ 1 ].push_back( index ); }
+    void spaces( size_t index ) { lists[ 2 ].push_back( index ); }
+    void paragraph( size_t lower, size_t upper ) { paragraphs.push_back( upper ); }
+    void script_span( const ual_script_span& span ) { spans.push_back( span ); }
+    void bidi_run( const ual_bidi_run& run ) { runs.push_back( run ); }
+};
+
+template < unsigned A >
+static bool check_template( std::u16string_view text )
+{
+    // Results of the template front end must match the C API.
+    template_sink sink;
+    ual::analyze< A >( text.data(), text.size(), sink );
+
+    template_sink expect;
+    ual_buffer* ub = ual_buffer_create();
+    ual_buffer_options( ub, UAL_OPTION_BREAK_LISTS );
+    size_t plower = 0;
+    while ( size_t length = ual_analyze_paragraph( ub, text.data() + plower, text.size() - plower ) )
+    {
+        ual_analyze_breaks( ub );
+        for ( size_t ilist = 0; ilist < 3; ++ilist )
+        {
+            ual_break_list list;
+            ual_break_list_get( ub, 1 << ilist, &list );
+            for ( size_t i = 0; i < list.count; ++i )
+            {
+                expect.lists[ ilist ].push_back( plower + list.positions[ i ] );
+            }
+        }
+
+        ual_analyze_bidi( ub, UAL_FROM_TEXT );
+        ual_script_span span;
+        ual_script_spans_begin( ub );
+        while ( ual_script_spans_next( ub, &span ) )
+        {
+            expect.spans.push_back( { plower + span.lower, plower + span.upper, span.script } );
+        }
+        ual_script_spans_end( ub );
+
+        ual_bidi_run run;
+        ual_bidi_runs_begin( ub );
+        while ( ual_bidi_runs_next( ub, &run ) )
+        {
+            expect.runs.push_back( { plower + run.lower, plower + run.upper, run.level } );
+        }
+        ual_bidi_runs_end( ub );
+
+        plower += length;
+        expect.paragraphs.push_back( plower );
+    }
+    ual_buffer_release( ub );
+
+    bool match = sink.paragraphs == expect.paragraphs;
+    match = match && ( ! ( A & ual::clusters ) || sink.lists[ 0 ] == expect.lists[ 0 ] );
+    match = match && ( ! ( A & ual::lines ) || ( sink.lists[ 1 ] == expect.lists[ 1 ] && sink.lists[ 2 ] == expect.lists[ 2 ] ) );
+    match = match && sink.spans.size() == ( A & ual::script ? expect.spans.size() : 0 );
+    for ( size_t i = 0; match && i < sink.spans.size(); ++i )
+    {
+        const ual_script_span& a = sink.spans[ i ];
+        const ual_script_span& b = expect.spans[ i ];
+        match = a.lower == b.lower && a.upper == b.upper && a.script == b.script;
+    }
+    match = match && sink.runs.size() == ( A & ual::bidi ? expect.runs.size() : 0 );
+    for ( size_t i = 0; match && i < sink.runs.size(); ++i )
+    {
+        const ual_bidi_run& a = sink.runs[ i ];
+        const ual_bidi_run& b = expect.runs[ i ];
+        match = a.lower == b.lower && a.upper == b.upper && a.level == b.level;
+    }
+    return match;
+}
+
+template < size_t N >
+static bool check_literal( ual_buffer* ub, const char16_t ( &text )[ N ], const ual::literal_breaks< N >& breaks )
+{
+    // Compile-time analysis of a literal must match runtime analysis.
+    size_t list_index[ 3 ] = { 0, 0, 0 };
+    size_t plower = 0;
+    bool match = breaks.size == N - 1;
+    while ( size_t length = ual_analyze_paragraph( ub, text + plower, N - 1 - plower ) )
+    {
+        ual_analyze_breaks( ub );
+        const ual_char* c = ual_buffer_chars( ub );
+        for ( size_t i = 0; match && i < length; ++i )
+        {
+            match = c[ i ].bc == breaks.flags[ plower + i ];
+        }
+
+        for ( size_t ilist = 0; ilist < 3; ++ilist )
+        {
+            ual_break_list a, b;
+            ual_break_list_get( ub, 1 << ilist, &a );
+            b = breaks.list( 1 << ilist );
+            match = match && list_index[ ilist ] + a.count <= b.count;
+            for ( size_t i = 0; match && i < a.count; ++i )
+            {
+                match = a.positions[ i ] + plower == b.positions[ list_index[ ilist ]++ ];
+            }
+        }
+
+        plower += length;
+    }
+
+    for ( size_t ilist = 0; ilist < 3; ++ilist )
+    {
+        match = match && list_index[ ilist ] == breaks.list( 1 << ilist ).count;
+    }
+    return match;
+}
+
+static bool check_literals()
+{
+    static_assert( ual::analyze_literal_breaks( u"a b" ).flags[ 1 ] == ( UAL_BREAK_CLUSTER | UAL_BREAK_SPACES ) );
+    static_assert( ual::analyze_literal_breaks( u"a b" ).flags[ 2 ] == ( UAL_BREAK_CLUSTER | UAL_BREAK_LINE ) );
+
+    static constexpr char16_t LATIN[] = u"Hello, world!  The price is $(12.50) \u2014 or (3) items.";
+    static constexpr char16_t EMOJI[] = u"\U0001F468\u200D\U0001F469\u200D\U0001F467 family \U0001F1EC\U0001F1E7\U0001F1EB";
+    static constexpr char16_t MIXED[] = u"\u0627\u0644\u0639\u0631\u0628\u064A\u0629 123 \u05E9\u05DC\u05D5\u05DD \u4E2D\u6587\u3002";
+    static constexpr char16_t LINES[] = u"Line one\r\nLine two\n\nThird \u2029 fourth \r";
+    static constexpr char16_t LONE[] = { 0xD800, u'a', 0xDC00, u' ', 0xDBFF, 0 };
+    static constexpr char16_t EMPTY[] = u"";
+
+    static constexpr auto LATIN_BREAKS = ual::analyze_literal_breaks( LATIN );
+    static constexpr auto EMOJI_BREAKS = ual::analyze_literal_breaks( EMOJI );
+    static constexpr auto MIXED_BREAKS = ual::analyze_literal_breaks( MIXED );
+    static constexpr auto LINES_BREAKS = ual::analyze_literal_breaks( LINES );
+    static constexpr auto LONE_BREAKS = ual::analyze_literal_breaks( LONE );
+    static constexpr auto EMPTY_BREAKS = ual::analyze_literal_breaks( EMPTY );
+
+    ual_buffer* ub = ual_buffer_create();
+    ual_buffer_options( ub, UAL_OPTION_BREAK_LISTS );
+    bool match = check_literal( ub, LATIN, LATIN_BREAKS )
+        && check_literal( ub, EMOJI, EMOJI_BREAKS )
+        && check_literal( ub, MIXED, MIXED_BREAKS )
+        && check_literal( ub, LINES, LINES_BREAKS )
+        && check_literal( ub, LONE, LONE_BREAKS )
+        && check_literal( ub, EMPTY, EMPTY_BREAKS );
+    ual_buffer_release( ub );
+    return match;
+}
+
+static std::vector< ual_line > buffer_lines( ual_buffer* ub )
+{
+    std::vector< ual_line > lines;
+    ual_line line;
+    ual_lines_begin( ub );
+    while ( ual_lines_next( ub, &line ) )
+    {
+        lines.push_back( line );
+    }
+    ual_lines_end( ub );
+    return lines;
+}
+
+static std::vector< ual_line > fit_lines( ual_buffer* ub, std::u16string_view text, const ual_fit_params& params, bool optimal )
+{
+    // Every unit has an advance of one.
+    ual_analyze_paragraph( ub, text.data(), text.size() );
+    ual_analyze_breaks( ub );
+    std::vector< float > advances( ual_buffer_size( ub ), 1.0f );
+    if ( optimal )
+        ual_fit_optimal( ub, advances.data(), &params );
+    else
+        ual_fit_greedy( ub, advances.data(), &params );
+
+    return buffer_lines( ub );
+}
+
+static bool check_lines( const std::vector< ual_line >& lines, std::initializer_list< ual_line > expect )
+{
+    if ( lines.size() != expect.size() )
+    {
+        return false;
+    }
+
+    const ual_line* e = expect.begin();
+    for ( size_t i = 0; i < lines.size(); ++i )
+    {
+        const ual_line& a = lines[ i ];
+        const ual_line& b = e[ i ];
+        if ( a.lower != b.lower || a.upper != b.upper || a.spaces != b.spaces || a.width != b.width || a.ratio != b.ratio )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct fit_demerits_log
+{
+    size_t length;
+    size_t calls;
+    bool last_ok;
+};
+
+static float fit_one_word( void* context, const ual_line* line, bool last )
+{
+    // Prefer lines containing a single word.
+    fit_demerits_log* log = (fit_demerits_log*)context;
+    log->calls += 1;
+    log->last_ok = log->last_ok && last == ( line->upper == log->length );
+    return line->upper - line->lower > 2 ? 1000.0f : 1.0f;
+}
+
+static bool check_fit()
+{
+    ual_buffer* ub = ual_buffer_create();
+    bool match = true;
+
+    // Greedy fills the first line, total-fit balances the first two.
+    ual_fit_params params = { 9.0f, 1.0f, 0.0f, 0, nullptr, nullptr };
+    match = match && check_lines( fit_lines( ub, u"aa bbb c d eee ffff g", params, false ),
+        { { 0, 9, 8, 8.0f, 0.5f }, { 9, 15, 14, 5.0f, 4.0f }, { 15, 21, 21, 6.0f, 0.0f } } );
+    match = match && check_lines( fit_lines( ub, u"aa bbb c d eee ffff g", params, true ),
+        { { 0, 7, 6, 6.0f, 3.0f }, { 7, 15, 14, 7.0f, 1.0f }, { 15, 21, 21, 6.0f, 0.0f } } );
+
+    // The last line is not stretched, and its trailing spaces are glue.
+    params = { 10.0f, 1.0f, 0.0f, 0, nullptr, nullptr };
+    match = match && check_lines( fit_lines( ub, u"aa bb  ", params, false ), { { 0, 7, 5, 5.0f, 0.0f } } );
+    match = match && check_lines( fit_lines( ub, u"aa bb  ", params, true ), { { 0, 7, 5, 5.0f, 0.0f } } );
+
+    // A word wider than the line overflows, without disturbing other lines.
+    params = { 6.0f, 1.0f, 0.0f, 0, nullptr, nullptr };
+    for ( bool optimal : { false, true } )
+    {
+        match = match && check_lines( fit_lines( ub, u"aa a bbbbbbbbbb cc dd", params, optimal ),
+            { { 0, 5, 4, 4.0f, 2.0f }, { 5, 16, 15, 10.0f, -INFINITY }, { 16, 21, 21, 5.0f, 0.0f } } );
+    }
+
+    // Lines span at most window break opportunities.
+    params = { 100.0f, 1.0f, 0.0f, 2, nullptr, nullptr };
+    match = match && check_lines( fit_lines( ub, u"a b c d e f", params, true ),
+        { { 0, 4, 3, 3.0f, 97.0f }, { 4, 8, 7, 3.0f, 97.0f }, { 8, 11, 11, 3.0f, 0.0f } } );
+    params.window = 0;
+    match = match && check_lines( fit_lines( ub, u"a b c d e f", params, true ), { { 0, 11, 11, 11.0f, 0.0f } } );
+
+    // Client demerits replace TeX's, and are told which line is last.
+    fit_demerits_log log = { 11, 0, true };
+    params = { 100.0f, 1.0f, 0.0f, 0, fit_one_word, &log };
+    match = match && check_lines( fit_lines( ub, u"a b c d e f", params, true ),
+        { { 0, 2, 1, 1.0f, INFINITY }, { 2, 4, 3, 1.0f, INFINITY }, { 4, 6, 5, 1.0f, INFINITY },
+          { 6, 8, 7, 1.0f, INFINITY }, { 8, 10, 9, 1.0f, INFINITY }, { 10, 11, 11, 1.0f, 0.0f } } );
+    match = match && log.calls != 0 && log.last_ok;
+
+    ual_buffer_release( ub );
+    return match;
+}
+
+static bool same_lines( const std::vector< ual_line >& a, const std::vector< ual_line >& b )
+{
+    bool match = a.size() == b.size();
+    for ( size_t i = 0; match && i < a.size(); ++i )
+    {
+        match = a[ i ].lower == b[ i ].lower
+            && a[ i ].upper == b[ i ].upper
+            && a[ i ].spaces == b[ i ].spaces
+            && a[ i ].width == b[ i ].width
+            && a[ i ].ratio == b[ i ].ratio;
+    }
+    return match;
+}
+
+static bool check_skeleton()
+{
+    // Skeleton queries must match fitting the buffer directly, at any width.
+    static const char16_t TEXT[] = u"The quick brown fox jumps over the lazy dog.  Pack my box with "
+        u"five dozen liquor jugs \U0001F600 — antidisestablishmentarianism, etc.   ";
+    const float WIDTHS[] = { 4.0f, 11.0f, 17.5f, 26.0f, 40.0f, 1000.0f };
+
+    ual_buffer* ub = ual_buffer_create();
+    ual_analyze_paragraph( ub, TEXT, sizeof( TEXT ) / sizeof( TEXT[ 0 ] ) - 1 );
+    ual_analyze_breaks( ub );
+
+    // Advances are exact in binary, so running totals match.
+    size_t length = ual_buffer_size( ub );
+    std::vector< float > advances( length );
+    for ( size_t i = 0; i < length; ++i )
+    {
+        advances[ i ] = TEXT[ i ] == 'i' || TEXT[ i ] == 'l' ? 0.5f : TEXT[ i ] == 'm' ? 1.5f : 1.0f;
+    }
+
+    ual_skeleton* sk = ual_skeleton_create( ub, advances.data() );
+    std::vector< std::vector< ual_line > > expect;
+    for ( float width : WIDTHS )
+    {
+        ual_fit_params params = { width, 0.5f, 0.33f, 0, nullptr, nullptr };
+        ual_fit_greedy( ub, advances.data(), &params );
+        expect.push_back( buffer_lines( ub ) );
+        ual_fit_optimal( ub, advances.data(), &params );
+        expect.push_back( buffer_lines( ub ) );
+    }
+
+    // Query using a buffer analyzing a different paragraph.
+    ual_buffer* uq = ual_buffer_create();
+    ual_analyze_paragraph( uq, u"unrelated", 9 );
+    bool match = ual_skeleton_size( sk ) == length;
+    for ( size_t i = 0; match && i < sizeof( WIDTHS ) / sizeof( WIDTHS[ 0 ] ); ++i )
+    {
+        ual_fit_params params = { WIDTHS[ i ], 0.5f, 0.33f, 0, nullptr, nullptr };
+        match = ual_skeleton_greedy( sk, uq, &params ) == expect[ i * 2 ].size()
+            && same_lines( buffer_lines( uq ), expect[ i * 2 ] )
+            && ual_skeleton_optimal( sk, uq, &params ) == expect[ i * 2 + 1 ].size()
+            && same_lines( buffer_lines( uq ), expect[ i * 2 + 1 ] );
+    }
+    match = match && ual_buffer_size( uq ) == 9;
+
+    ual_skeleton_release( sk );
+    ual_buffer_release( uq );
+    ual_buffer_release( ub );
+    return match;
+}
+
+static void workload_paragraph( ual_buffer* ub, std::u16string_view text, bool bidi, bool spans )
+{
+    ual_analyze_paragraph( ub, text.data(), text.size() );
+    if ( bidi )
+    {
+        ual_analyze_bidi( ub, UAL_FROM_TEXT );
+    }
+
+    // Spans are only counted if iteration reaches the end of the paragraph.
+    ual_script_span span;
+    ual_script_spans_begin( ub );
+    while ( ual_script_spans_next( ub, &span ) && spans )
+    {
+    }
+    ual_script_spans_end( ub );
+}
+
+static bool check_workload()
+{
+    ual_buffer* ub = ual_buffer_create();
+    ual_workload_reset();
+    ual_workload_enable( true );
+
+    std::u16string scripts;
+    for ( size_t i = 0; i < 1100; ++i )
+    {
+        scripts += u"aα";
+    }
+    std::u16string huge( (size_t)1 << 23, u'a' );
+
+    workload_paragraph( ub, u"hello", true, true );
+    workload_paragraph( ub, u"\U0001F600aα", false, false );
+    workload_paragraph( ub, u"א⁧a⁩", true, true );
+    workload_paragraph( ub, scripts, false, true );
+    workload_paragraph( ub, huge, false, false );
+
+    ual_workload_enable( false );
+    workload_paragraph( ub, u"א not counted", true, true );
+    ual_buffer_release( ub );
+
+    // Lengths 5, 4, 4, and 2200 have bit lengths 3, 3, 3, and 12.  2^23
+    // clamps to the last bucket.  2200 spans also clamps to the last bucket.
+    // Iteration of the two spans in the second paragraph stops early, but
+    // the single span of the last paragraph completes its iteration.  The
+    // third paragraph has a Hebrew span and a Latin span.
+    ual_workload w;
+    ual_workload_snapshot( &w );
+    ual_workload expect = {};
+    expect.paragraphs = 5;
+    expect.units = 5 + 4 + 4 + 2200 + ( (size_t)1 << 23 );
+    expect.surrogate_units = 2;
+    expect.complexity[ UAL_COMPLEXITY_ALL_LEFT ] = 1;
+    expect.complexity[ UAL_COMPLEXITY_ISOLATES ] = 1;
+    expect.length[ 3 ] = 3;
+    expect.length[ 12 ] = 1;
+    expect.length[ 23 ] = 1;
+    expect.surrogates[ 0 ] = 4;
+    expect.surrogates[ 4 ] = 1;
+    expect.script_spans[ 1 ] = 2;
+    expect.script_spans[ 2 ] = 1;
+    expect.script_spans[ 11 ] = 1;
+    bool match = memcmp( &w, &expect, sizeof( ual_workload ) ) == 0;
+
+    // Dump measures like snprintf.
+    static const char* const LINES[] =
+    {
+        "paragraphs 5\n", "surrogate_units 2\n", "complexity.isolates 1\n", "complexity.explicit 0\n",
+        "length[4..] 3\n", "length[2048..] 1\n", "length[4194304..] 1\n",
+        "surrogates[0/8] 4\n", "surrogates[4/8] 1\n",
+        "script_spans[1..] 2\n", "script_spans[2..] 1\n", "script_spans[1024..] 1\n",
+    };
+    char dump[ 4096 ];
+    size_t length = ual_workload_dump( dump, sizeof( dump ) );
+    match = match && length < sizeof( dump ) && strlen( dump ) == length && ual_workload_dump( nullptr, 0 ) == length;
+    for ( const char* line : LINES )
+    {
+        match = match && strstr( dump, line ) != nullptr;
+    }
+
+    char small[ 8 ];
+    match = match && ual_workload_dump( small, sizeof( small ) ) == length && strncmp( small, dump, 7 ) == 0 && small[ 7 ] == 0;
+
+    ual_workload_reset();
+    return match;
+}
+
 int main( int argc, char* argv[] )
 {
     // Reopen stdin and stdout.
@@ -73,8 +900,30 @@ int main( int argc, char* argv[] )
     _setmode( _fileno( stdout ), _O_BINARY );
 #endif
 
+    // Check for self-test argument.
+    static const struct { const char* name; bool ( *check )(); const char* mismatch; } SELF_TESTS[] =
+    {
+        { "fit", check_fit, "FIT_MISMATCH" },
+        { "skeleton", check_skeleton, "SKELETON_MISMATCH" },
+        { "workload", check_workload, "WORKLOAD_MISMATCH" },
+        { "literal", check_literals, "LITERAL_MISMATCH" },
+    };
+
+    for ( const auto& self_test : SELF_TESTS )
+    {
+        if ( argc > 1 && strcmp( argv[ 1 ], self_test.name ) == 0 )
+        {
+            if ( ! self_test.check() )
+            {
+                printf( "%s\n", self_test.mismatch );
+                return EXIT_FAILURE;
+            }
+            return EXIT_SUCCESS;
+        }
+    }
+
     // Check for bidi argument.
-    enum { NONE, LEVEL_RUNS, EXPLICIT, WEAK, NEUTRAL } bidi_mode = NONE;
+    enum { NONE, LEVEL_RUNS, EXPLICIT, WEAK, NEUTRAL, RUNS } bidi_mode = NONE;
     if ( argc > 1 )
     {
         const char* arg = argv[ 1 ];
@@ -82,6 +931,7 @@ int main( int argc, char* argv[] )
         if ( strcmp( arg, "x" ) == 0 ) bidi_mode = EXPLICIT;
         if ( strcmp( arg, "w" ) == 0 ) bidi_mode = WEAK;
         if ( strcmp( arg, "n" ) == 0 ) bidi_mode = NEUTRAL;
+        if ( strcmp( arg, "r" ) == 0 ) bidi_mode = RUNS;
     }
 
     // Get paragraph override level.
@@ -109,6 +959,11 @@ int main( int argc, char* argv[] )
 
     // Create buffer.
     ual_buffer* ub = ual_buffer_create();
+    ual_buffer_options( ub, UAL_OPTION_BREAK_LISTS | UAL_OPTION_BREAK_VARINT | UAL_OPTION_CLUSTER_INDEX | UAL_OPTION_BIDI_MIRRORS );
+
+    // Runs of all paragraphs, to compare with batch analysis.
+    std::vector< ual_bidi_run > text_runs;
+    unsigned text_level = override_paragraph_level != UAL_FROM_TEXT ? override_paragraph_level : 0;
 
     // Process paragraph-by-paragraph.
     size_t plower = 0;
@@ -139,6 +994,22 @@ int main( int argc, char* argv[] )
             }
         }
 
+        // Check break lists.
+        if ( ! check_break_list( ub, UAL_BREAK_CLUSTER )
+            || ! check_break_list( ub, UAL_BREAK_LINE )
+            || ! check_break_list( ub, UAL_BREAK_SPACES ) )
+        {
+            printf( "BREAK_LIST_MISMATCH\n" );
+            return EXIT_FAILURE;
+        }
+
+        // Check cluster index.
+        if ( ! check_cluster_index( ub ) )
+        {
+            printf( "CLUSTER_INDEX_MISMATCH\n" );
+            return EXIT_FAILURE;
+        }
+
         // Analyze script.
         ual_script_span span;
         ual_script_spans_begin( ub );
@@ -157,6 +1028,71 @@ int main( int argc, char* argv[] )
         }
         ual_script_spans_end( ub );
 
+        // Analyze bidi runs.
+        if ( bidi_mode == RUNS )
+        {
+            unsigned paragraph_level = ual_analyze_bidi( ub, override_paragraph_level );
+            if ( plower == length )
+            {
+                text_level = paragraph_level;
+            }
+
+            // Bidi runs survive break analysis.
+            ual_analyze_breaks( ub );
+            ual_bidi_run run;
+            ual_bidi_runs_begin( ub );
+            while ( ual_bidi_runs_next( ub, &run ) )
+            {
+                printf( "BIDI_RUN %u %zu %zu\n", run.level, run.lower, run.upper );
+                text_runs.push_back( { plower - length + run.lower, plower - length + run.upper, run.level } );
+
+                size_t mirror_count = 0;
+                const ual_bidi_mirror* mirrors = ual_bidi_run_mirrors( ub, &mirror_count );
+                for ( size_t i = 0; i < mirror_count; ++i )
+                {
+                    printf( "BIDI_MIRROR %zu %04X\n", mirrors[ i ].index, mirrors[ i ].mirror );
+                }
+            }
+            ual_bidi_runs_end( ub );
+
+            // Print isolating run sequences.
+            size_t sequence_number = 0;
+            ual_bidi_sequence sequence;
+            ual_bidi_sequences_begin( ub );
+            while ( ual_bidi_sequences_next( ub, &sequence ) )
+            {
+                for ( size_t i = 0; i < sequence.range_count; ++i )
+                {
+                    printf
+                    (
+                        "BIDI_SEQUENCE %zu:%u:%c%c %zu %zu\n",
+                        sequence_number,
+                        sequence.level,
+                        sequence.sos ? 'R' : 'L',
+                        sequence.eos ? 'R' : 'L',
+                        sequence.ranges[ i ].lower,
+                        sequence.ranges[ i ].upper
+                    );
+                }
+                sequence_number += 1;
+            }
+            ual_bidi_sequences_end( ub );
+
+            if ( ! check_bidi_sequences( ub ) )
+            {
+                printf( "BIDI_SEQUENCES_MISMATCH\n" );
+                return EXIT_FAILURE;
+            }
+
+            // Check levels.
+            if ( ! check_bidi_levels( ub ) )
+            {
+                printf( "BIDI_LEVELS_MISMATCH\n" );
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+
         // Analyze bidi stages.
         if ( bidi_mode != NONE )
         {
@@ -168,13 +1104,13 @@ int main( int argc, char* argv[] )
                 const ual_level_run* nrun = &ub->level_runs.at( irun + 1 );
                 printf
                 (
-                    "LEVEL_RUN %u:%u:%c%c %u %u\n",
+                    "LEVEL_RUN %u:%u:%c%c %zu %zu\n",
                     prun->level,
                     prun->inext,
                     boundary_class( prun->sos ),
                     boundary_class( prun->eos ),
-                    prun->start,
-                    nrun->start
+                    (size_t)prun->start,
+                    (size_t)nrun->start
                 );
             }
             if ( bidi_mode == LEVEL_RUNS )
@@ -182,7 +1118,18 @@ int main( int argc, char* argv[] )
                 continue;
             }
 
-            if ( ub->bidi_analysis.complexity != BIDI_ALL_LEFT )
+            if ( ub->bidi_analysis.complexity == BIDI_STRONG )
+            {
+                if ( bidi_mode == WEAK )
+                {
+                    bidi_weak( ub );
+                }
+                else if ( bidi_mode == NEUTRAL )
+                {
+                    bidi_strong( ub );
+                }
+            }
+            else if ( ub->bidi_analysis.complexity != BIDI_ALL_LEFT )
             {
                 if ( bidi_mode != EXPLICIT )
                 {
@@ -207,6 +1154,47 @@ int main( int argc, char* argv[] )
         }
     }
 
+    // Check batch analysis.
+    if ( bidi_mode == RUNS && ! check_bidi_batch( ub, text, override_paragraph_level, text_level, text_runs ) )
+    {
+        printf( "BIDI_BATCH_MISMATCH\n" );
+        return EXIT_FAILURE;
+    }
+
+    // Check archived results.
+    if ( bidi_mode == RUNS && ! check_archive( text, override_paragraph_level ) )
+    {
+        printf( "ARCHIVE_MISMATCH\n" );
+        return EXIT_FAILURE;
+    }
+
+    // Check fused analysis.
+    if ( ( bidi_mode == NONE || bidi_mode == RUNS ) && ! check_fused( text, override_paragraph_level ) )
+    {
+        printf( "FUSED_MISMATCH\n" );
+        return EXIT_FAILURE;
+    }
+
+    // Check template front end.
+    if ( bidi_mode == NONE && ! ( check_template< ual::clusters >( text ) && check_template< ual::breaks | ual::script >( text ) ) )
+    {
+        printf( "TEMPLATE_MISMATCH\n" );
+        return EXIT_FAILURE;
+    }
+
+    if ( bidi_mode == RUNS && override_paragraph_level == UAL_FROM_TEXT && ! check_template< ual::breaks | ual::script | ual::bidi >( text ) )
+    {
+        printf( "TEMPLATE_MISMATCH\n" );
+        return EXIT_FAILURE;
+    }
+
+    // Check cached results.
+    if ( ( bidi_mode == NONE || bidi_mode == RUNS ) && ! check_cache( text, override_paragraph_level, bidi_mode == RUNS ) )
+    {
+        printf( "CACHE_MISMATCH\n" );
+        return EXIT_FAILURE;
+    }
+
     ual_buffer_release( ub );
 
     // Complete.
@@ -49,9 +49,23 @@ with open( sys.argv[ 2 ], 'r' ) as f:
             cases.append( [ line, "wr", "" ] )
         elif line == "BIDINEUTRAL":
             cases.append( [ line, "n", "" ] )
+        elif line == "BIDIRUN":
+            cases.append( [ line, "r", "" ] )
+        elif line == "BIDIRUNR":
+            cases.append( [ line, "rr", "" ] )
+        elif line == "BIDISEQ":
+            cases.append( [ line, "r", "" ] )
         elif line != "":
             cases[ -1 ][ 2 ] += line
 
+# Set upper bound of the most recent span, ignoring mirror marks.
+def close_span( paragraph, index ):
+    for entry in reversed( paragraph ):
+        if entry[ 0 ] != "BIDI_MIRROR":
+            if entry[ -1 ] == -1:
+                entry[ -1 ] = index
+            return
+
 # Perform cases.
 for case in cases:
 
@@ -70,8 +84,7 @@ for case in cases:
         if c == '[':
             j = code.find( ']', i )
             if j != -1:
-                if p[ -1 ][ -1 ][ -1 ] == -1:
-                    p[ -1 ][ -1 ][ -1 ] = index
+                close_span( p[ -1 ], index )
                 p[ -1 ].append( [ code[ i : j ], index, -1 ] )
                 i = j + 1
                 continue
@@ -96,8 +109,7 @@ for case in cases:
 
         elif c == '/':
             if code[ i ] == '/':
-                if p[ -1 ][ -1 ][ -1 ] == -1:
-                    p[ -1 ][ -1 ][ -1 ] = index
+                close_span( p[ -1 ], index )
                 upper = len( text ) // 2
                 p[ -1 ][ 0 ][ -1 ] = upper
                 p.append( [ [ upper, upper ] ] )
@@ -116,6 +128,10 @@ for case in cases:
             p[ -1 ].append( [ "BREAK_CLUSTER", index ] )
             continue
 
+        elif c == '~':
+            p[ -1 ].append( [ "BIDI_MIRROR", index ] )
+            continue
+
         elif c == ':':
             p[ -1 ].append( [ "BREAK_SPACES", index ] )
             continue
@@ -130,8 +146,7 @@ for case in cases:
         print( "'", code, "'", sep = "" )
         raise Exception( 'invalid test case code' )
 
-    if p[ -1 ][ -1 ][ -1 ] == -1:
-        p[ -1 ][ -1 ][ -1 ] = index
+    close_span( p[ -1 ], index )
     p[ -1 ][ 0 ][ -1 ] = len( text ) // 2
 
     # Remove empty paragraph
@@ -143,6 +158,8 @@ for case in cases:
     if case[ 1 ] != None:
         if case[ 1 ] == 'wr':
             command.extend( [ 'w', '1' ] )
+        elif case[ 1 ] == 'rr':
+            command.extend( [ 'r', '1' ] )
         else:
             command.append( case[ 1 ] )
     result = subprocess.run( command, input = text, stdout = subprocess.PIPE, stderr = subprocess.STDOUT )
@@ -180,9 +197,23 @@ for case in cases:
         if kind == 'BIDILRUN' and info[ 0 ] == 'LEVEL_RUN':
             q[ -1 ].append( [ info[ 1 ], int( info[ 2 ] ), int( info[ 3 ] ) ] )
 
+        if ( kind == 'BIDIRUN' or kind == 'BIDIRUNR' ) and info[ 0 ] == 'BIDI_RUN':
+            q[ -1 ].append( [ info[ 1 ], int( info[ 2 ] ), int( info[ 3 ] ) ] )
+
+        if ( kind == 'BIDIRUN' or kind == 'BIDIRUNR' ) and info[ 0 ] == 'BIDI_MIRROR':
+            q[ -1 ].append( [ info[ 0 ], int( info[ 1 ] ) ] )
+
+        if kind == 'BIDISEQ' and info[ 0 ] == 'BIDI_SEQUENCE':
+            q[ -1 ].append( [ info[ 1 ], int( info[ 2 ] ), int( info[ 3 ] ) ] )
+
         if ( kind == 'BIDIEXPLICIT' or kind == 'BIDIWEAK' or kind == 'BIDIWEAKR' or kind == 'BIDINEUTRAL' ) and info[ 0 ] == 'BIDI_CLASS':
             q[ -1 ].append( info )
 
+    # Sequences are reported in sequence order, spans are in text order.
+    if kind == 'BIDISEQ':
+        for paragraph in q:
+            paragraph[ 1: ] = sorted( paragraph[ 1: ], key = lambda span : span[ 1 ] )
+
     if p != q:
         print( kind, text.decode( 'utf-16-le', errors = 'replace' ) )
         print( code )
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+#
+#  ualyzetest.py
+#
+#  Created by Edmund Kapusniak on 19/10/2026.
+#  Copyright © 2026 Edmund Kapusniak.
+#
+#  Licensed under the ISC License. See LICENSE file in the project root for
+#  full license information.
+#
+
+import sys
+import os
+import json
+import struct
+import tempfile
+import subprocess
+
+ualyze = sys.argv[ 1 ]
+corpora = sys.argv[ 2: ]
+exitcode = 0
+
+def run( args ):
+    result = subprocess.run( [ ualyze ] + args, stdout = subprocess.PIPE, stderr = subprocess.PIPE )
+    if result.returncode != 0:
+        print( "FAILED:", ' '.join( args ) )
+        print( result.stderr.decode( 'utf-8', errors = 'replace' ) )
+        sys.exit( 1 )
+    return result.stdout
+
+def paragraphs( output ):
+    # Results without the file and byte offset, which depend on the encoding.
+    results = []
+    for line in output.decode( 'utf-8' ).splitlines():
+        p = json.loads( line )
+        results.append( ( p[ 'units' ], p[ 'lines' ], p[ 'scripts' ], p[ 'level' ], p[ 'runs' ] ) )
+    return results
+
+def check( name, ok ):
+    global exitcode
+    if not ok:
+        print( "FAILED:", name )
+        exitcode = 1
+
+# Results are written in file order whatever the threads and chunk size.
+expected = run( [ '--threads', '1' ] + corpora )
+check( "jsonl parses", len( paragraphs( expected ) ) > 0 )
+check( "jsonl order", run( [ '--threads', '4', '--chunk', '64' ] + corpora ) == expected )
+
+# Each binary frame is an archive, in file order.
+output = run( [ '--format', 'binary', '--threads', '4', '--chunk', '64' ] + corpora )
+frames = []
+offset = 0
+while offset + 24 <= len( output ):
+    ifile, chunk_offset, size = struct.unpack_from( '<QQQ', output, offset )
+    check( "binary archive", output[ offset + 24 : offset + 28 ] == b'UALZ' )
+    frames.append( ( ifile, chunk_offset ) )
+    offset += 24 + size
+check( "binary frames", offset == len( output ) and frames == sorted( frames ) and len( frames ) > len( corpora ) )
+
+# UTF-16 input gives the same results as UTF-8.  A trailing odd byte, here a
+# line feed, is ignored.
+with tempfile.TemporaryDirectory() as directory:
+    for encoding, bom in ( ( 'utf-16-le', b'\xFF\xFE' ), ( 'utf-16-be', b'\xFE\xFF' ) ):
+        converted = []
+        for i, corpus in enumerate( corpora ):
+            with open( corpus, 'rb' ) as f:
+                text = f.read().decode( 'utf-8' )
+            path = os.path.join( directory, '%s.%d.txt' % ( encoding, i ) )
+            with open( path, 'wb' ) as f:
+                f.write( bom + text.encode( encoding ) + b'\n' )
+            converted.append( path )
+        check( encoding, paragraphs( run( [ '--threads', '3', '--chunk', '64' ] + converted ) ) == paragraphs( expected ) )
+
+sys.exit( exitcode )
@@ -0,0 +1,691 @@
+//
+//  ualyze.cpp
+//
+//  Created by Edmund Kapusniak on 19/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the ISC License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <ualyze.h>
+
+#if defined( _WIN32 )
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+
+/*
+    Bulk analysis of text files.  Each file is mapped into memory, and split
+    into chunks of roughly equal size at line feeds, which always end a
+    paragraph.  Chunks are analyzed in parallel by a pool of workers, each
+    with its own buffer.  The main thread writes results in file order as
+    they complete, and workers run at most a window of chunks ahead of it, so
+    that the results waiting to be written do not grow with the file.
+
+    Files are UTF-8, unless they start with a UTF-16 byte order mark, or
+    --utf16 is given for little-endian UTF-16 without one.  UTF-16LE is
+    analyzed in place.  Other input is converted to UTF-16 a chunk at a time.
+
+    The jsonl format writes one line for each paragraph.  Offsets are in
+    bytes from the start of the file, and positions within a paragraph are in
+    UTF-16 code units.  The binary format writes each chunk as an archive
+    (see ual_archive_open), preceded by a frame of three 64-bit little-endian
+    values: the index of the file on the command line, the byte offset of the
+    chunk in the file, and the size of the archive.
+*/
+
+enum input_encoding { UTF8, UTF16LE, UTF16BE };
+enum output_format { JSONL, BINARY };
+
+struct input_file
+{
+    const char* path;
+    const uint8_t* data;
+    size_t size;
+    input_encoding encoding;
+    size_t start;                   // offset after any byte order mark.
+#if defined( _WIN32 )
+    std::vector< uint8_t > contents;
+#endif
+};
+
+struct chunk_result
+{
+    std::string output;
+    size_t paragraphs;
+    size_t units;
+};
+
+struct worker_state
+{
+    ual_buffer* ub;
+    std::u16string text;
+};
+
+struct chunk_queue
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    const input_file* file;
+    size_t ifile;
+    const std::vector< size_t >* bounds;
+    output_format format;
+    size_t chunk_count;
+    size_t next;                    // next chunk to analyze.
+    size_t written;                 // chunks written, in order.
+    std::vector< chunk_result > results;
+    std::vector< bool > done;
+    bool stop;
+};
+
+static bool map_file( input_file* file )
+{
+#if defined( _WIN32 )
+    FILE* f = fopen( file->path, "rb" );
+    if ( ! f )
+    {
+        return false;
+    }
+    uint8_t buffer[ 65536 ];
+    while ( size_t size = fread( buffer, 1, sizeof( buffer ), f ) )
+    {
+        file->contents.insert( file->contents.end(), buffer, buffer + size );
+    }
+    fclose( f );
+    file->data = file->contents.data();
+    file->size = file->contents.size();
+    return true;
+#else
+    int fd = open( file->path, O_RDONLY );
+    if ( fd < 0 )
+    {
+        return false;
+    }
+
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 )
+    {
+        close( fd );
+        return false;
+    }
+
+    file->data = nullptr;
+    file->size = st.st_size;
+    if ( file->size )
+    {
+        void* p = mmap( nullptr, file->size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if ( p == MAP_FAILED )
+        {
+            close( fd );
+            return false;
+        }
+        madvise( p, file->size, MADV_SEQUENTIAL );
+        file->data = (const uint8_t*)p;
+    }
+
+    close( fd );
+    return true;
+#endif
+}
+
+static void unmap_file( input_file* file )
+{
+#if defined( _WIN32 )
+    file->contents = std::vector< uint8_t >();
+#else
+    if ( file->data )
+    {
+        munmap( (void*)file->data, file->size );
+    }
+#endif
+    file->data = nullptr;
+}
+
+static void detect_encoding( input_file* file, bool utf16 )
+{
+    const uint8_t* p = file->data;
+    file->encoding = utf16 ? UTF16LE : UTF8;
+    file->start = 0;
+    if ( file->size >= 2 && p[ 0 ] == 0xFF && p[ 1 ] == 0xFE )
+    {
+        file->encoding = UTF16LE;
+        file->start = 2;
+    }
+    else if ( file->size >= 2 && p[ 0 ] == 0xFE && p[ 1 ] == 0xFF )
+    {
+        file->encoding = UTF16BE;
+        file->start = 2;
+    }
+    else if ( file->size >= 3 && p[ 0 ] == 0xEF && p[ 1 ] == 0xBB && p[ 2 ] == 0xBF )
+    {
+        file->encoding = UTF8;
+        file->start = 3;
+    }
+}
+
+static std::vector< size_t > split_chunks( const input_file* file, size_t chunk_size )
+{
+    // Chunk boundaries are just after a line feed.
+    std::vector< size_t > bounds;
+    size_t unit = file->encoding == UTF8 ? 1 : 2;
+    size_t lf = file->encoding == UTF16BE ? 1 : 0;
+    size_t lower = file->start;
+    bounds.push_back( lower );
+    while ( lower < file->size )
+    {
+        size_t upper = lower + std::max( chunk_size - chunk_size % 2, unit );
+        while ( upper < file->size )
+        {
+            const uint8_t* p = (const uint8_t*)memchr( file->data + upper, '\n', file->size - upper );
+            if ( ! p )
+            {
+                upper = file->size;
+                break;
+            }
+
+            // The line feed must be a whole code unit.
+            size_t index = p - file->data;
+            size_t offset = ( index - file->start ) % unit;
+            size_t other = index - lf + ( 1 - lf );
+            if ( offset == lf && ( unit == 1 || ( other < file->size && file->data[ other ] == 0 ) ) )
+            {
+                upper = index - lf + unit;
+                break;
+            }
+            upper = index + 1;
+        }
+
+        lower = std::min( upper, file->size );
+        bounds.push_back( lower );
+    }
+    return bounds;
+}
+
+static size_t decode_utf8( const uint8_t* p, const uint8_t* end, char32_t* out_c )
+{
+    // Invalid sequences decode to U+FFFD one byte at a time.
+    uint8_t lead = p[ 0 ];
+    if ( lead < 0x80 )
+    {
+        *out_c = lead;
+        return 1;
+    }
+
+    size_t length = lead >= 0xF0 && lead < 0xF5 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC2 && lead < 0xE0 ? 2 : 0;
+    if ( length == 0 || (size_t)( end - p ) < length )
+    {
+        *out_c = 0xFFFD;
+        return 1;
+    }
+
+    char32_t c = lead & ( 0x7F >> length );
+    for ( size_t i = 1; i < length; ++i )
+    {
+        if ( ( p[ i ] & 0xC0 ) != 0x80 )
+        {
+            *out_c = 0xFFFD;
+            return 1;
+        }
+        c = ( c << 6 ) | ( p[ i ] & 0x3F );
+    }
+
+    static const char32_t MINIMUM[ 5 ] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if ( c < MINIMUM[ length ] || c > 0x10FFFF || ( c >= 0xD800 && c <= 0xDFFF ) )
+    {
+        *out_c = 0xFFFD;
+        return 1;
+    }
+
+    *out_c = c;
+    return length;
+}
+
+static void convert_utf8( const uint8_t* p, const uint8_t* end, std::u16string* out_text )
+{
+    out_text->clear();
+    while ( p < end )
+    {
+        char32_t c;
+        p += decode_utf8( p, end, &c );
+        if ( c >= 0x10000 )
+        {
+            out_text->push_back( (char16_t)( 0xD800 + ( ( c - 0x10000 ) >> 10 ) ) );
+            out_text->push_back( (char16_t)( 0xDC00 + ( ( c - 0x10000 ) & 0x3FF ) ) );
+        }
+        else
+        {
+            out_text->push_back( (char16_t)c );
+        }
+    }
+}
+
+static size_t utf8_bytes( const uint8_t* p, const uint8_t* end, size_t units )
+{
+    // Number of bytes which decode to a number of UTF-16 code units.
+    const uint8_t* start = p;
+    while ( units && p < end )
+    {
+        char32_t c;
+        p += decode_utf8( p, end, &c );
+        units -= c >= 0x10000 ? std::min< size_t >( units, 2 ) : 1;
+    }
+    return p - start;
+}
+
+static void append_json_string( std::string* out, const char* s )
+{
+    out->push_back( '"' );
+    for ( ; *s; ++s )
+    {
+        unsigned char c = *s;
+        if ( c == '"' || c == '\\' )
+        {
+            out->push_back( '\\' );
+            out->push_back( c );
+        }
+        else if ( c < 0x20 )
+        {
+            char escape[ 8 ];
+            snprintf( escape, sizeof( escape ), "\\u%04X", c );
+            out->append( escape );
+        }
+        else
+        {
+            out->push_back( c );
+        }
+    }
+    out->push_back( '"' );
+}
+
+static void append_paragraph_json( std::string* out, ual_buffer* ub, const input_file* file, size_t offset )
+{
+    char number[ 64 ];
+    size_t length = ual_buffer_size( ub );
+
+    out->append( "{\"file\":" );
+    append_json_string( out, file->path );
+    snprintf( number, sizeof( number ), ",\"offset\":%zu,\"units\":%zu", offset, length );
+    out->append( number );
+
+    // Line break opportunities.
+    ual_analyze_breaks( ub );
+    ual_break_list list;
+    ual_break_list_get( ub, UAL_BREAK_LINE, &list );
+    out->append( ",\"lines\":[" );
+    for ( size_t i = 0; i < list.count; ++i )
+    {
+        snprintf( number, sizeof( number ), "%s%zu", i ? "," : "", (size_t)list.positions[ i ] );
+        out->append( number );
+    }
+
+    // Script spans.
+    out->append( "],\"scripts\":[" );
+    ual_script_span span;
+    bool first = true;
+    ual_script_spans_begin( ub );
+    while ( ual_script_spans_next( ub, &span ) )
+    {
+        snprintf
+        (
+            number, sizeof( number ), "%s[\"%c%c%c%c\",%zu,%zu]",
+            first ? "" : ",",
+            ( span.script >> 24 ) & 0xFF,
+            ( span.script >> 16 ) & 0xFF,
+            ( span.script >> 8  ) & 0xFF,
+            ( span.script       ) & 0xFF,
+            span.lower,
+            span.upper
+        );
+        out->append( number );
+        first = false;
+    }
+    ual_script_spans_end( ub );
+
+    // Bidi runs.
+    unsigned paragraph_level = ual_analyze_bidi( ub, UAL_FROM_TEXT );
+    snprintf( number, sizeof( number ), "],\"level\":%u,\"runs\":[", paragraph_level );
+    out->append( number );
+    ual_bidi_run run;
+    first = true;
+    ual_bidi_runs_begin( ub );
+    while ( ual_bidi_runs_next( ub, &run ) )
+    {
+        snprintf( number, sizeof( number ), "%s[%zu,%zu,%u]", first ? "" : ",", run.lower, run.upper, run.level );
+        out->append( number );
+        first = false;
+    }
+    ual_bidi_runs_end( ub );
+
+    out->append( "]}\n" );
+}
+
+static void append_u64( std::string* out, uint64_t value )
+{
+    for ( size_t i = 0; i < 8; ++i )
+    {
+        out->push_back( (char)( value >> ( i * 8 ) ) );
+    }
+}
+
+static chunk_result analyze_chunk( worker_state* ws, const input_file* file, size_t ifile, size_t lower, size_t upper, output_format format )
+{
+    chunk_result result = { std::string(), 0, 0 };
+
+    // Get UTF-16 text for the chunk.
+    const uint8_t* bytes = file->data + lower;
+    const char16_t* text = nullptr;
+    size_t size = 0;
+    if ( file->encoding == UTF8 )
+    {
+        convert_utf8( bytes, file->data + upper, &ws->text );
+        text = ws->text.data();
+        size = ws->text.size();
+    }
+    else if ( file->encoding == UTF16LE && (uintptr_t)bytes % alignof( char16_t ) == 0 )
+    {
+        text = (const char16_t*)bytes;
+        size = ( upper - lower ) / 2;
+    }
+    else
+    {
+        ws->text.resize( ( upper - lower ) / 2 );
+        unsigned hi = file->encoding == UTF16BE ? 0 : 1;
+        for ( size_t i = 0; i < ws->text.size(); ++i )
+        {
+            ws->text[ i ] = (char16_t)( bytes[ i * 2 + hi ] << 8 | bytes[ i * 2 + ( hi ^ 1 ) ] );
+        }
+        text = ws->text.data();
+        size = ws->text.size();
+    }
+
+    ual_archive_writer* aw = format == BINARY ? ual_archive_writer_create() : nullptr;
+    size_t offset = lower;
+    size_t index = 0;
+    while ( index < size )
+    {
+        size_t length = ual_analyze_paragraph( ws->ub, text + index, size - index );
+        if ( format == JSONL )
+        {
+            append_paragraph_json( &result.output, ws->ub, file, offset );
+        }
+        else
+        {
+            ual_archive_writer_add( aw, ws->ub, UAL_FROM_TEXT );
+        }
+
+        // Track the byte offset of the next paragraph.
+        if ( file->encoding == UTF8 )
+        {
+            offset += utf8_bytes( file->data + offset, file->data + upper, length );
+        }
+        else
+        {
+            offset += length * 2;
+        }
+
+        result.paragraphs += 1;
+        index += length;
+    }
+    result.units = size;
+
+    if ( aw )
+    {
+        size_t archive_size = 0;
+        const void* archive = ual_archive_writer_data( aw, &archive_size );
+        append_u64( &result.output, ifile );
+        append_u64( &result.output, lower );
+        append_u64( &result.output, archive_size );
+        result.output.append( (const char*)archive, archive_size );
+        ual_archive_writer_release( aw );
+    }
+
+    return result;
+}
+
+static void analyze_chunks( chunk_queue* queue, worker_state* ws )
+{
+    // Results are stored in a window of slots indexed by chunk.
+    std::unique_lock< std::mutex > lock( queue->mutex );
+    size_t window = queue->results.size();
+    while ( true )
+    {
+        queue->changed.wait( lock, [ & ]()
+        {
+            return queue->stop || ( queue->next < queue->chunk_count && queue->next < queue->written + window );
+        } );
+        if ( queue->stop )
+        {
+            return;
+        }
+
+        size_t ichunk = queue->next++;
+        const input_file* file = queue->file;
+        size_t ifile = queue->ifile;
+        size_t lower = ( *queue->bounds )[ ichunk ];
+        size_t upper = ( *queue->bounds )[ ichunk + 1 ];
+        output_format format = queue->format;
+        lock.unlock();
+
+        chunk_result result = analyze_chunk( ws, file, ifile, lower, upper, format );
+
+        lock.lock();
+        queue->results[ ichunk % window ] = std::move( result );
+        queue->done[ ichunk % window ] = true;
+        queue->changed.notify_all();
+    }
+}
+
+static size_t peak_memory()
+{
+#if defined( _WIN32 )
+    return 0;
+#else
+    struct rusage usage;
+    getrusage( RUSAGE_SELF, &usage );
+#if defined( __APPLE__ )
+    return usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+static void usage()
+{
+    fprintf( stderr, "usage: ualyze [--format jsonl|binary] [--threads n] [--chunk bytes] [--utf16] [-o output] file...\n" );
+}
+
+int main( int argc, char* argv[] )
+{
+    output_format format = JSONL;
+    size_t threads = std::max( std::thread::hardware_concurrency(), 1u );
+    size_t chunk_size = 4 * 1024 * 1024;
+    bool utf16 = false;
+    const char* output_path = nullptr;
+    std::vector< input_file > files;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( strcmp( argv[ i ], "--format" ) == 0 && i + 1 < argc )
+        {
+            const char* name = argv[ ++i ];
+            if ( strcmp( name, "jsonl" ) == 0 )
+                format = JSONL;
+            else if ( strcmp( name, "binary" ) == 0 )
+                format = BINARY;
+            else
+            {
+                usage();
+                return EXIT_FAILURE;
+            }
+        }
+        else if ( strcmp( argv[ i ], "--threads" ) == 0 && i + 1 < argc )
+            threads = std::max( atoi( argv[ ++i ] ), 1 );
+        else if ( strcmp( argv[ i ], "--chunk" ) == 0 && i + 1 < argc )
+            chunk_size = std::max( atol( argv[ ++i ] ), 2l );
+        else if ( strcmp( argv[ i ], "--utf16" ) == 0 )
+            utf16 = true;
+        else if ( strcmp( argv[ i ], "-o" ) == 0 && i + 1 < argc )
+            output_path = argv[ ++i ];
+        else if ( argv[ i ][ 0 ] == '-' )
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+        else
+        {
+            input_file file = {};
+            file.path = argv[ i ];
+            files.push_back( file );
+        }
+    }
+
+    if ( files.empty() )
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    FILE* out = output_path ? fopen( output_path, "wb" ) : stdout;
+    if ( ! out )
+    {
+        fprintf( stderr, "cannot open %s\n", output_path );
+        return EXIT_FAILURE;
+    }
+
+    chunk_queue queue;
+    queue.file = nullptr;
+    queue.ifile = 0;
+    queue.bounds = nullptr;
+    queue.format = format;
+    queue.chunk_count = 0;
+    queue.next = 0;
+    queue.written = 0;
+    queue.results.resize( threads * 4 );
+    queue.done.resize( threads * 4 );
+    queue.stop = false;
+
+    std::vector< worker_state > workers( threads );
+    std::vector< std::thread > pool;
+    for ( worker_state& ws : workers )
+    {
+        ws.ub = ual_buffer_create();
+        ual_buffer_options( ws.ub, UAL_OPTION_BREAK_LISTS );
+        pool.emplace_back( analyze_chunks, &queue, &ws );
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t total_bytes = 0;
+    size_t total_units = 0;
+    size_t total_paragraphs = 0;
+    bool failed = false;
+
+    for ( size_t ifile = 0; ifile < files.size(); ++ifile )
+    {
+        input_file* file = &files[ ifile ];
+        if ( ! map_file( file ) )
+        {
+            fprintf( stderr, "cannot read %s\n", file->path );
+            failed = true;
+            continue;
+        }
+
+        detect_encoding( file, utf16 );
+        std::vector< size_t > bounds = split_chunks( file, chunk_size );
+
+        // Hand the chunks of this file to the workers.
+        std::unique_lock< std::mutex > lock( queue.mutex );
+        queue.file = file;
+        queue.ifile = ifile;
+        queue.bounds = &bounds;
+        queue.chunk_count = bounds.size() - 1;
+        queue.next = 0;
+        queue.written = 0;
+        queue.changed.notify_all();
+
+        // Write each result as soon as it and all earlier results are done.
+        size_t window = queue.results.size();
+        while ( queue.written < queue.chunk_count )
+        {
+            size_t islot = queue.written % window;
+            queue.changed.wait( lock, [ & ]() { return (bool)queue.done[ islot ]; } );
+            chunk_result result = std::move( queue.results[ islot ] );
+            queue.done[ islot ] = false;
+            lock.unlock();
+
+            fwrite( result.output.data(), 1, result.output.size(), out );
+            total_units += result.units;
+            total_paragraphs += result.paragraphs;
+
+            lock.lock();
+            queue.written += 1;
+            queue.changed.notify_all();
+        }
+
+        // Every chunk has been written, so no worker is reading the file.
+        queue.file = nullptr;
+        queue.bounds = nullptr;
+        queue.chunk_count = 0;
+        lock.unlock();
+
+        total_bytes += file->size;
+        unmap_file( file );
+    }
+
+    {
+        std::lock_guard< std::mutex > lock( queue.mutex );
+        queue.stop = true;
+        queue.changed.notify_all();
+    }
+    for ( std::thread& thread : pool )
+    {
+        thread.join();
+    }
+
+    if ( out != stdout )
+    {
+        fclose( out );
+    }
+    else
+    {
+        fflush( out );
+    }
+
+    for ( worker_state& ws : workers )
+    {
+        ual_buffer_release( ws.ub );
+    }
+
+    // Report throughput and memory.
+    double seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+    fprintf
+    (
+        stderr,
+        "ualyze: %zu files, %zu bytes, %zu units, %zu paragraphs in %.3f s, %.1f MB/s, %zu threads, peak memory %.1f MB\n",
+        files.size(),
+        total_bytes,
+        total_units,
+        total_paragraphs,
+        seconds,
+        seconds > 0.0 ? total_bytes / seconds / 1e6 : 0.0,
+        threads,
+        peak_memory() / 1e6
+    );
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -34,7 +34,7 @@
     written authorization of the copyright holder.
 */
 
-extern const ucdb_entry UCDB_TABLE[] = {
+UCDB_TABLE_STORAGE ucdb_entry UCDB_TABLE[] = {
     { UCDB_SCRIPT_UNKNOWN, UCDB_BIDI_L, UCDB_LBREAK_XX, false, UCDB_CBREAK_XX, false },
     { UCDB_SCRIPT_COMMON, UCDB_BIDI_BN, UCDB_LBREAK_CM, false, UCDB_CBREAK_CONTROL, false },
     { UCDB_SCRIPT_COMMON, UCDB_BIDI_S, UCDB_LBREAK_BA, false, UCDB_CBREAK_CONTROL, false },
@@ -671,7 +671,7 @@ extern const ucdb_entry UCDB_TABLE[] = {
     { UCDB_SCRIPT_COMMON, UCDB_BIDI_BN, UCDB_LBREAK_CM, false, UCDB_CBREAK_EXTEND, false },
 };
 
-static const uint8_t
+static constexpr uint8_t
 ucdb_u8[4352] =
 {
     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
@@ -947,7 +947,7 @@ ucdb_u8[4352] =
    73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73,
    73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73, 73,178,
 };
-static const uint16_t
+static constexpr uint16_t
 ucdb_u16[16240] =
 {
      0,   1,   0,   2,   3,   4,   5,   6,   7,   8,   8,   9,   7,   8,   8,  10,
@@ -1967,7 +1967,7 @@ ucdb_u16[16240] =
    278,   1, 278, 278, 278, 278, 278, 278, 633, 633, 633, 633, 633, 633, 633, 633,
 };
 
-uint_fast16_t
+constexpr uint_fast16_t
 ucdb_index (unsigned u)
 {
   return u<1114112u?ucdb_u16[5824+(((ucdb_u16[((ucdb_u8[u>>3>>5])<<5)+((u>>3)&31u)])<<3)+((u)&7u))]:0;
@@ -70,3 +70,21 @@ ucdb_bracket_kind ucdb_paired_bracket( char32_t cp, char32_t* out_paired )
     *out_paired = i->paired;
     return (ucdb_bracket_kind)i->kind;
 }
+
+char32_t ucdb_mirrored_glyph( char32_t cp )
+{
+    auto i = std::lower_bound
+    (
+        std::begin( UCDB_BRACKET_MIRROR ),
+        std::end( UCDB_BRACKET_MIRROR ),
+        cp,
+        []( const ucdb_mapped_entry& entry, char32_t cp ) { return entry.cp < cp; }
+    );
+
+    if ( i == std::end( UCDB_BRACKET_MIRROR ) || i->cp != cp )
+    {
+        return cp;
+    }
+
+    return i->mapped;
+}
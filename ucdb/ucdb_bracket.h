@@ -38,4 +38,9 @@ enum ucdb_bracket_kind
 
 ucdb_bracket_kind ucdb_paired_bracket( char32_t cp, char32_t* out_paired );
 
+// Map a codepoint to its Bidi_Mirroring_Glyph.  Codepoints without a mirrored
+// glyph are returned unchanged.
+
+char32_t ucdb_mirrored_glyph( char32_t cp );
+
 #endif
@@ -10,8 +10,9 @@
 #
 
 #
-# Run this script to generate a table of paired brackets and of canoncial
-# bracket decompositions from the Unicode Character Database.
+# Run this script to generate a table of paired brackets, of canoncial
+# bracket decompositions, and of mirrored glyphs from the Unicode Character
+# Database.
 #
 
 import sys
@@ -40,6 +41,9 @@ with open( path.join( ucd_path, 'UnicodeData.txt' ), 'r' ) as file:
 with open( path.join( ucd_path, 'BidiBrackets.txt' ), 'r' ) as file:
     bidi_brackets = parse_file( file )
 
+with open( path.join( ucd_path, 'BidiMirroring.txt' ), 'r' ) as file:
+    bidi_mirroring = parse_file( file )
+
 
 # Build bracket pair table.
 
@@ -73,3 +77,9 @@ for bracket, bpaired, kind in bidi_brackets:
 print( "};" )
 print()
 
+print( "const ucdb_mapped_entry UCDB_BRACKET_MIRROR[] = {" )
+for cp, mirror in sorted( bidi_mirroring, key = lambda entry : int( entry[ 0 ], 16 ) ):
+    print( f"    {{ 0x{cp}, 0x{mirror} }}," )
+print( "};" )
+print()
+
@@ -10,7 +10,10 @@
 
 #include "ucdb_table.h"
 #include "generated/script_enum.h"
+
+#define UCDB_TABLE_STORAGE extern const
 #include "generated/table_data.h"
+#undef UCDB_TABLE_STORAGE
 
 size_t ucdb_lookup( char32_t c )
 {
@@ -18,6 +18,7 @@
 # time of writing, the pip version of packTab is outdated and does not work.
 #
 
+import io
 import sys
 from os import path
 import packTab
@@ -139,7 +140,7 @@ if len( sys.argv ) < 3 or sys.argv[ 2 ] != 'enum':
 
     print()
 
-    print( "extern const ucdb_entry UCDB_TABLE[] = {" )
+    print( "UCDB_TABLE_STORAGE ucdb_entry UCDB_TABLE[] = {" )
     for script, bclass, lbreak, zspace, cbreak, paired in records:
         print( f"    {{ UCDB_SCRIPT_{script.upper()}, UCDB_BIDI_{bclass}, UCDB_LBREAK_{lbreak}, {'true' if zspace else 'false'}, UCDB_CBREAK_{cbreak.upper()}, {'true' if paired else 'false'} }}," )
     print( "};" )
@@ -152,7 +153,14 @@ if len( sys.argv ) < 3 or sys.argv[ 2 ] != 'enum':
     solution = packTab.pick_solution( solutions, compression=1 )
     code = packTab.Code( 'ucdb' )
     expr = solution.genCode( code, 'index' )
-    code.print_c()
+    output = io.StringIO()
+    code.print_c( file=output )
+
+    # Make the index usable in constant expressions.
+    output = output.getvalue()
+    output = output.replace( "static const ", "static constexpr " )
+    output = output.replace( "uint_fast16_t\nucdb_index", "constexpr uint_fast16_t\nucdb_index" )
+    print( output, end="" )
     print()
 
 else: